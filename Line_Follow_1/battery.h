@@ -0,0 +1,143 @@
+//battery.h
+/*********************************************************************
+ This contains all functions that measure the battery with the ADC
+ and scale the motor speeds and manoeuvre times so the robot behaves
+ the same on a fresh and a drained battery. The motor battery is
+ read on RB12 (AN12) through a divider; the internal band-gap
+ reference gives the PIC's own supply, which the ADC reads against.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define ADC_BATTERY 12 //AN12 (RB12), battery through the divider
+#define ADC_BANDGAP 0x1A //internal band-gap reference
+#define BANDGAP_MV 1200l //band-gap reference voltage (mV)
+#define BATTERY_DIVIDER 2 //battery voltage over the voltage on RB12 (10k/10k)
+#define BATTERY_NOMINAL 6000l //battery voltage the courses were tuned at (mV)
+#define BATTERY_CHECK 1000ul //time between battery readings during a run (ms)
+#define SCALE_MIN 800 //smallest scale used, for a battery above nominal (per mille)
+#define SCALE_MAX 1500 //largest scale used, for a nearly flat battery (per mille)
+
+//	Global Variables
+/********************************************************************/
+
+unsigned int supplyMv = 0; //PIC supply voltage from the last reading (mV)
+unsigned int batteryMv = 0; //battery voltage from the last reading (mV)
+unsigned long batteryRead = 0; //millis() of the last reading
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        measureBattery
+ *
+ * PreCondition:    initBattery has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    supplyScale in motor.h is updated
+ *
+ * Overview:  Reads the band-gap to find the PIC's supply voltage, then the
+ *            battery against it. The scale is the tuned battery voltage
+ *            over the measured one, so a drained battery gets longer duty
+ *            cycles and longer manoeuvres.
+ *
+ * Note:      A reading of 0 (no divider fitted) leaves the scale at 1000.
+ ******************************************************************************/
+
+void measureBattery (void)
+{
+        unsigned int bandgap = readAdc(ADC_BANDGAP);
+        unsigned int battery = readAdc(ADC_BATTERY);
+        long scale;
+
+        batteryRead = millis();
+        if(bandgap == 0 || battery == 0) return;
+
+        supplyMv = (unsigned int) (BANDGAP_MV * 4095l / bandgap);
+        batteryMv = (unsigned int) ((long) battery * supplyMv / 4095l * BATTERY_DIVIDER);
+
+        scale = BATTERY_NOMINAL * 1000l / batteryMv;
+        if(scale < SCALE_MIN) scale = SCALE_MIN;
+        if(scale > SCALE_MAX) scale = SCALE_MAX;
+        supplyScale = (int) scale;
+} //end measureBattery
+
+/*******************************************************************************
+ * Function:        checkBattery
+ *
+ * PreCondition:    initBattery has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    see measureBattery
+ *
+ * Overview:  Call on every pass of the main loop. Reads the battery again
+ *            once BATTERY_CHECK ms have passed since the last reading.
+ *
+ * Note:
+ ******************************************************************************/
+
+void checkBattery (void)
+{
+        if(millis() - batteryRead >= BATTERY_CHECK) measureBattery();
+} //end checkBattery
+
+/*******************************************************************************
+ * Function:        initBattery
+ *
+ * PreCondition:    initTimer and initMotors have been called, PORTB is set
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    RB12 becomes an analog input, the ADC is turned on
+ *
+ * Overview:  Turns on the ADC for single readings, then takes the first
+ *            reading.
+ *
+ * Note:
+ ******************************************************************************/
+
+void initBattery (void)
+{
+        ANSBbits.ANSB12 = 1;	//analog input
+        TRISBbits.TRISB12 = 1;
+        initAdc();
+        measureBattery();
+} //end initBattery
+
+/*******************************************************************************
+ * Function:        batteryTime
+ *
+ * PreCondition:    -
+ *
+ * Input:           time in milliseconds tuned at BATTERY_NOMINAL
+ *
+ * Output:          time in milliseconds for the battery as it is now
+ *
+ * Side Effects:    none
+ *
+ * Overview:  The duty cycles already make up for a low battery until the
+ *            faster wheel reaches 100%. Past that rampMotors gives both
+ *            wheels the same share of the speed they want, so the time is
+ *            stretched by what the faster wheel wants over what it gets.
+ *
+ * Note:      Uses the speeds set with setDuty, before profile and steering.
+ ******************************************************************************/
+
+unsigned long batteryTime (unsigned long milli)
+{
+        long fastest = leftDuty > rightDuty ? leftDuty : rightDuty;
+        long wanted = fastest * 10 * supplyScale / 1000; //faster wheel target for this battery (tenths of a percent)
+        long applied = wanted > 1000 ? 1000 : wanted; //what rampMotors gives it
+
+        if(applied <= 0 || applied >= wanted) return milli;
+        return milli * wanted / applied;
+} //end batteryTime
@@ -1,10 +1,19 @@
 //configBits.c
 /*******************************************************************
 	Configuration Bit Macros
+	Define USE_FRCPLL in the project's preprocessor macros to run
+	the core at 32MHz. All timing is derived from FCY.
 ********************************************************************/
 
+#ifdef USE_FRCPLL
+// Enable the internal 8MHz Fast RC OSC with 4x PLL (32MHz), Disable Two-speed startup
+_FOSCSEL(FNOSC_FRCPLL & IESO_OFF & SOSCSRC_DIG)
+#define FCY 16000000ul // instruction clock, Fosc/2 (16 MIPS)
+#else
 // Enable the internal 8MHz Fast RC OSC, Disable Two-speed startup
 _FOSCSEL(FNOSC_FRC & IESO_OFF & SOSCSRC_DIG)
+#define FCY 4000000ul // instruction clock, Fosc/2 (4 MIPS)
+#endif
 
 // Disable primary oscillator module, Do not route int OSC signal to pins 9-10
 _FOSC(POSCMOD_NONE & OSCIOFNC_OFF)
@@ -4,6 +4,27 @@
  initialization and function of the delay
 ********************************************************************/
 
+//	Definitions
+/********************************************************************/
+
+#define T1_PERIOD ((unsigned int) (FCY / 1000ul)) //Fcyc clock cycles in one millisecond
+#define TICKS_PER_US (FCY / 1000000ul) //Timer2/3 counts in one microsecond
+
+//	Global Variables
+/********************************************************************/
+
+volatile unsigned long msTicks = 0; //milliseconds since initTimer
+void (*tickHook)(void) = 0; //optional function run from the 1ms tick
+
+//periodic loop timing, read with the debugger
+unsigned long periodNext = 0; //ticks() when the next period starts
+int periodRunning = 0; //set once the first period has started
+unsigned long periodRestarts = 0; //times the loop fell a whole period behind
+unsigned long jitterMin = 0xFFFFFFFFul; //earliest wake-up after a period start (us)
+unsigned long jitterMax = 0; //latest wake-up after a period start (us)
+unsigned long jitterSum = 0; //total of all wake-up times, for the mean (us)
+unsigned long jitterCount = 0; //number of periods measured
+
 //	List of Functions
 /********************************************************************/
 
@@ -16,12 +37,15 @@
  *
  * Output:          none
  *
- * Side Effects:
+ * Side Effects:    Timer1 interrupt is enabled
  *
  * Overview:  This is intended to initialize the microcontroller peripherals
- *            , such as combining Timer2 and Timer3 so that we can generate
- *            delays using a 32-bit register. This will allow us to create very
- *            long delays if needed
+ *            , such as setting up Timer1 as a free-running 1ms system tick.
+ *            The Timer1 interrupt counts milliseconds in the background so
+ *            the main loop can check elapsed time with millis() and micros()
+ *            without stopping to wait on a timer flag. Timer2 and Timer3
+ *            are combined into a free-running 32-bit counter clocked at
+ *            Fcyc, which is read by ticks() for exact time stamps.
  *
  * Note:
  ******************************************************************************/
@@ -29,82 +53,335 @@
 void initTimer (void)
 {
 
-    //Combine Timer2 and Timer3 as a 32-bit Timer
-        T2CON = 0;
-        T3CON = 0;
+#ifdef USE_FRCPLL
+    //FRC postscaler 1:1 so the PLL is fed 8MHz and gives 32MHz
+        CLKDIVbits.RCDIV = 0;
+#endif
+
+    //Stop Timer1 while it is configured
+        T1CON = 0;
 
     //These settings will do the following:
-    // Use Fcyc as source (4MHz)
-    // Set prescale to 1:1 = 4MHz
-            // -results in 250ns/clock cycle
-            // (1/4,000,000 clock cycles/second)
-    // Stop any 16-bit Timer2 operation
-    // Stop any 16-bit Timer3 operation
+    // Use Fcyc as source (4MHz, or 16MHz with USE_FRCPLL)
+    // Set prescale to 1:1
+            // -results in 250ns/clock cycle (62.5ns with USE_FRCPLL)
+    // Period of FCY/1000 clock cycles = 1ms between interrupts
+
+        TMR1 = 0; 		//Clear contents of the Timer1 register
+        PR1 = T1_PERIOD - 1;	//Timer1 resets to 0 after PR1 is matched
+        msTicks = 0;		//restart the millisecond count
 
+	IFS0bits.T1IF = 0;	// Clear out the T1 flag
+	IEC0bits.T1IE = 1;	// Enable the Timer1 interrupt
+	T1CONbits.TON = 1;	// Turn on Timer1
+
+    //Combine Timer2 and Timer3 as a 32-bit Timer that counts every
+    //Fcyc clock cycle and rolls over at 0xFFFFFFFF with no interrupt
+        T2CON = 0;
+        T3CON = 0;
         TMR3 = 0; 		//Clear contents of the Timer3 register
         TMR2 = 0; 		//Clear contents of the Timer2 register
+        PR3 = 0xFFFF;		//count through the full 32 bits
+        PR2 = 0xFFFF;
 
-	IFS0bits.T3IF = 0;	// Clear out the T3 overflow flag
 	T2CONbits.T32 = 1; 	// Enable 32-bit Timer operation
-	T2CONbits.TON=1;	// Turn on Timer2 (32-bit Timer2/3)
+	T2CONbits.TON = 1;	// Turn on Timer2 (32-bit Timer2/3)
 
 } //end initializeTimer
 
 /*******************************************************************************
- * Function:        delay
+ * Function:        _T1Interrupt
  *
- * PreCondition:    -
+ * PreCondition:    initTimer has been called
  *
- * Input:           number of milliseconds
+ * Input:           none
  *
  * Output:          none
  *
+ * Side Effects:    msTicks is incremented
+ *
+ * Overview:  Timer1 interrupt service routine. Runs once every millisecond
+ *            and advances the system tick, then runs tickHook if one is set.
+ *
+ * Note:      tickHook runs inside the interrupt and must be short.
+ ******************************************************************************/
+
+void __attribute__((__interrupt__, no_auto_psv)) _T1Interrupt (void)
+{
+        msTicks++;
+        if(tickHook) tickHook();
+        IFS0bits.T1IF = 0;	//clear the flag so the next tick can interrupt
+} //end _T1Interrupt
+
+/*******************************************************************************
+ * Function:        millis
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          milliseconds since initTimer
+ *
+ * Side Effects:    Timer1 interrupt is held off for a few instructions
+ *
+ * Overview:  Returns the system tick. The 32-bit count is read in two
+ *            halves by the 16-bit core, so the Timer1 interrupt is masked
+ *            while it is copied.
+ *
+ * Note:      The count wraps after 4,294,967,295 ms (49 days). Compare
+ *            times by subtracting them as unsigned longs so the wrap is
+ *            harmless.
+ ******************************************************************************/
+
+unsigned long millis (void)
+{
+        unsigned long ms;
+
+        IEC0bits.T1IE = 0;
+        ms = msTicks;
+        IEC0bits.T1IE = 1;
+
+        return ms;
+} //end millis
+
+/*******************************************************************************
+ * Function:        micros
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          microseconds since initTimer
+ *
+ * Side Effects:    Timer1 interrupt is held off for a few instructions
+ *
+ * Overview:  Combines the millisecond count with the Timer1 register to
+ *            give a time stamp with 1us resolution. If Timer1 rolled over
+ *            while its interrupt was masked, the pending tick is added.
+ *
+ * Note:      The count wraps after 4,294,967,295 us (71 minutes).
+ ******************************************************************************/
+
+unsigned long micros (void)
+{
+        unsigned long ms;
+        unsigned int count;
+
+        IEC0bits.T1IE = 0;
+        ms = msTicks;
+        count = TMR1;
+        if(IFS0bits.T1IF && count < (T1_PERIOD / 2)) ms++; //tick is pending
+        IEC0bits.T1IE = 1;
+
+        return ms * 1000ul + count / (unsigned int) (FCY / 1000000ul);
+} //end micros
+
+/*******************************************************************************
+ * Function:        ticks
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          Fcyc clock cycles counted by Timer2/3
+ *
+ * Side Effects:    interrupts are held off for the two reads
+ *
+ * Overview:  Returns the 32-bit Timer2/3 count. Reading TMR2 latches TMR3
+ *            into TMR3HLD, so the two halves match as long as nothing else
+ *            reads TMR2 in between. The CN interrupt time stamps edges with
+ *            ticks(), so interrupts are held off with DISI for the two
+ *            reads. One tick is 250ns (62.5ns with USE_FRCPLL).
+ *
+ * Note:      The count wraps after 1073s (268s with USE_FRCPLL). Compare
+ *            ticks by subtracting them so the wrap is harmless.
+ ******************************************************************************/
+
+unsigned long ticks (void)
+{
+        unsigned int lsw;
+        unsigned int msw;
+
+        asm volatile ("disi #0x3FFF");	//no interrupt may read TMR2 in between
+        lsw = TMR2;		//must be read first to latch TMR3HLD
+        msw = TMR3HLD;
+        DISICNT = 0;		//interrupts back on
+        return ((unsigned long) msw << 16) | lsw;
+} //end ticks
+
+/*******************************************************************************
+ * Function:        elapsedUs
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           time stamp from ticks()
+ *
+ * Output:          microseconds since the time stamp
+ *
  * Side Effects:    none
  *
- * Overview:  This function generates a delay using milliseconds as the sole
- *            parameter. The Timer2/3 combination keeps track of the number
- *            of clock cycles needed. When that value reaches whatever
- *            is loaded in the PR2 register, an interrupt flag for
- *            is set, indicating the delay is complete. *
- *
- * Note:      32 bits mean 4,294,967,296 (2^32) in decimal
-              The smallest value being 0, the largest 4,294,967,295
-              This translates into a delay range of 0 up to 1073s! or
- *            17 minutes!! (4,294,967,296/250ns period)
+ * Overview:  Measures a time interval from a ticks() time stamp.
+ *
+ * Note:      Only valid for intervals shorter than the ticks() wrap time.
  ******************************************************************************/
 
-void delay (unsigned long milli)
+unsigned long elapsedUs (unsigned long since)
 {
+        return (ticks() - since) / TICKS_PER_US;
+} //end elapsedUs
 
-    // declare variable to use to calculate PR3:PR2
-        unsigned long PeriodRegisterValue;
+/*******************************************************************************
+ * Function:        deadlineIn
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           number of microseconds from now
+ *
+ * Output:          deadline to pass to deadlineReached()
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Turns a timeout into an absolute ticks() value.
+ *
+ * Note:      The timeout must be shorter than half the ticks() wrap time.
+ ******************************************************************************/
 
-    //initialize with 32-bit value
-        PeriodRegisterValue = milli * 4000ul;
+unsigned long deadlineIn (unsigned long micro)
+{
+        return ticks() + micro * TICKS_PER_US;
+} //end deadlineIn
 
-    //Clear Timer Registers
-        TMR2 = 0;
-        TMR3 = 0;
+/*******************************************************************************
+ * Function:        deadlineReached
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           deadline from deadlineIn()
+ *
+ * Output:          1 once the deadline has passed, 0 before then
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Used to put a timeout on loops that wait for a sensor, so a
+ *            robot that has lost the line cannot spin forever.
+ *
+ *            deadline = deadlineIn(timeout);
+ *            while(!digitalRead(left) && !deadlineReached(deadline));
+ *
+ * Note:
+ ******************************************************************************/
+
+int deadlineReached (unsigned long deadline)
+{
+        return (long) (ticks() - deadline) >= 0;
+} //end deadlineReached
+
+/*******************************************************************************
+ * Function:        delay
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           number of milliseconds
+ *
+ * Output:          none
+ *
+ * Side Effects:    the CPU idles for most of the delay
+ *
+ * Overview:  This function generates a delay using milliseconds as the sole
+ *            parameter. The time is measured from the Timer1 system tick,
+ *            so Timer1 keeps counting and interrupts keep being serviced
+ *            while the delay runs. The CPU is put in Idle mode between
+ *            ticks instead of spinning.
+ *
+ * Note:      Time is compared in microseconds, so the delay range is
+ *            0 up to 4,294,967ms (71 minutes).
+ ******************************************************************************/
 
-    //load upper 2 bytes of 32-bit
-        PR3 = (unsigned int) (PeriodRegisterValue >> 16);
+void delay (unsigned long milli)
+{
 
-    //load lower 2 bytes of-32 bit
-        PR2 = (unsigned int) (PeriodRegisterValue & 0x0000FFFF);
+    //time stamp for the start of the delay
+        unsigned long start = micros();
 
-    //continue to loop until the flag has been set
-        while (!IFS0bits.T3IF==1);
+    //time to wait and time already waited in microseconds
+        unsigned long wait = milli * 1000ul;
+        unsigned long elapsed;
 
-    //clear interrupt flag so the entire process can repeat
-    //Timer 2 and 3 automatically reset to 0
-        IFS0bits.T3IF=0;
+    //idle until enough time has passed
+        while ((elapsed = micros() - start) < wait){
+            idleFor(wait - elapsed);
+        }
 
 } // end delay procedure
 
+/*******************************************************************************
+ * Function:        waitPeriod
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           loop period in microseconds
+ *
+ * Output:          none
+ *
+ * Side Effects:    the CPU idles until the next period starts
+ *
+ * Overview:  Holds a loop to a fixed period. Each period starts a whole
+ *            period after the one before it, not after the end of the work
+ *            done in the loop, so the loop overhead does not add up and a
+ *            counter of periods is a count of real time. How late each
+ *            wake-up is after its period start is kept in jitterMin,
+ *            jitterMax and jitterSum.
+ *
+ * Note:      If the loop falls a whole period behind (for example after a
+ *            branch that did not call waitPeriod), the periods start again
+ *            from now and periodRestarts is incremented.
+ ******************************************************************************/
 
+void waitPeriod (unsigned long micro)
+{
+        unsigned long period = micro * TICKS_PER_US;
+        unsigned long late;
 
+    //first period or a whole period behind: start again from now
+        if(!periodRunning || (long) (ticks() - periodNext) >= (long) period){
+            if(periodRunning) periodRestarts++;
+            periodNext = ticks();
+            periodRunning = 1;
+        }
+        periodNext += period;
 
+    //idle until the start of the next period
+        while(!deadlineReached(periodNext)){
+            idleFor((periodNext - ticks()) / TICKS_PER_US);
+        }
 
+    //measure how late the wake-up was
+        late = elapsedUs(periodNext);
+        if(late < jitterMin) jitterMin = late;
+        if(late > jitterMax) jitterMax = late;
+        jitterSum += late;
+        jitterCount++;
 
+} //end waitPeriod
 
+/*******************************************************************************
+ * Function:        jitterMean
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          mean wake-up time after a period start in microseconds
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Mean of the jitter measured by waitPeriod.
+ *
+ * Note:      Returns 0 before the first period.
+ ******************************************************************************/
 
+unsigned long jitterMean (void)
+{
+        if(jitterCount == 0) return 0;
+        return jitterSum / jitterCount;
+} //end jitterMean
@@ -0,0 +1,96 @@
+//eeprom.h
+/*********************************************************************
+ This contains all functions that read and write words in the data
+ EEPROM (the eedata region at 0x7FFE00), which keeps its contents
+ when the power is off. Flashing the program again erases it unless
+ "Preserve EEPROM Memory" is on in the programmer settings.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define EE_WORDS 20 //words of data EEPROM used by the programs
+
+//word of eeData used for each saved value
+#define EE_TRIM_MAGIC 0 //TRIM_MAGIC once the wheel trim has been saved
+#define EE_TRIM_LEFT 1 //left wheel trim (%)
+#define EE_TRIM_RIGHT 2 //right wheel trim (%)
+#define EE_IR_MAGIC 3 //IR_MAGIC once the sensor thresholds have been saved
+#define EE_IR_LOW 4 //off the line threshold of each sensor (IR_MAX words)
+#define EE_IR_HIGH 12 //on the line threshold of each sensor (IR_MAX words)
+
+//	Global Variables
+/********************************************************************/
+
+//saved values, only reached through eeRead and eeWrite
+unsigned int __attribute__((space(eedata), aligned(2))) eeData[EE_WORDS];
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        eeRead
+ *
+ * PreCondition:    -
+ *
+ * Input:           word of eeData (EE_TRIM_MAGIC, EE_TRIM_LEFT, ...)
+ *
+ * Output:          value saved in that word
+ *
+ * Side Effects:    TBLPAG is changed
+ *
+ * Overview:  Reads one word of the data EEPROM with a table read.
+ *
+ * Note:      A word that was never written reads 0xFFFF.
+ ******************************************************************************/
+
+unsigned int eeRead (int index)
+{
+        TBLPAG = __builtin_tblpage(&eeData[index]);
+        return __builtin_tblrdl(__builtin_tbloffset(&eeData[index]));
+} //end eeRead
+
+/*******************************************************************************
+ * Function:        eeWrite
+ *
+ * PreCondition:    -
+ *
+ * Input:           word of eeData and the value to save in it
+ *
+ * Output:          none
+ *
+ * Side Effects:    TBLPAG and NVMCON are changed, the CPU waits about 8ms
+ *                  for the erase and write
+ *
+ * Overview:  Erases one word of the data EEPROM and programs the new value.
+ *            Interrupts are held off during the unlock sequence.
+ *
+ * Note:      The word is left alone if it already holds the value, so
+ *            saving the same settings again does not wear the EEPROM. Turn
+ *            on "Preserve EEPROM Memory" in the programmer settings, or
+ *            flashing the program erases the saved values.
+ ******************************************************************************/
+
+void eeWrite (int index, unsigned int value)
+{
+        unsigned int offset;
+
+        if(eeRead(index) == value) return;
+
+        TBLPAG = __builtin_tblpage(&eeData[index]);
+        offset = __builtin_tbloffset(&eeData[index]);
+
+    //erase the word
+        NVMCON = 0x4058;
+        __builtin_tblwtl(offset, 0);
+        asm volatile ("disi #5");
+        __builtin_write_NVM();
+        while(NVMCONbits.WR);
+
+    //program the new value
+        NVMCON = 0x4004;
+        __builtin_tblwtl(offset, value);
+        asm volatile ("disi #5");
+        __builtin_write_NVM();
+        while(NVMCONbits.WR);
+} //end eeWrite
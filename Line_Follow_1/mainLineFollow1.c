@@ -3,47 +3,68 @@
  * Author: Daniel Liang
  * Date: 2016/11/22
  * Purpose: The first line following course
- * PIC used: PIC24F32KA302 operating at 8MHz
+ * PIC used: PIC24F32KA302 operating at 8MHz (32MHz with USE_FRCPLL)
  * I/O ports used and hardware attached:
  * RB15 connected to blue LED
  * RA0 connected to pushbutton
  * RA0 connected to first IR sensor
  * RA1 connected to second IR sensor
+ * RA3, RB4, RB13, RB14, RB0, RB1 connected to extra IR sensors (IR_SENSORS)
+ * RB5 connected to the IR emitters through a transistor (MODULATED_IR)
+ * RB12 connected to the motor battery through a 10k/10k divider
  * L293:
- * pin 2 to RB15
- * pin 7 to RB14
- * pin 10 to RB13
- * pin 13 to RB12
+ * pin 1 to OC1 (left wheel PWM)
+ * pin 9 to OC2 (right wheel PWM)
+ * pin 2 to RB9 (1A, left wheel)
+ * pin 7 to RB8 (2A, left wheel)
+ * pin 10 to RB6 (3A, right wheel)
+ * pin 15 to RB7 (4A, right wheel)
 */
 
 //Include Files
 #include "p24F32KA302.h"
 #include "configBits.h"
+#include "power.h"
 #include "delay.h"
+#include "motor.h"
+#include "eeprom.h"
+#include "adc.h"
+#include "battery.h"
+#include "irsensor.h"
+#include "trim.h"
+#include "latency.h"
 
 //constants for pins
-const int LF = 9; //Left red 1A
-const int LR = 8; //left green 2A
-const int RF = 6; //Right red 3A
-const int RR = 7; //Right green 4A
 const int left = 0; //left sensor
 const int right = 1; //right sensor
 const int indicator = 15; //indicator of robot
-
-//constants for direction of robot
-const int FWD = 0; //go forward
-const int LEFT = 1; //turn left
-const int RIGHT = 2; //turn right
-const int CW = 3; //turn clockwise
-const int CCW = 4; //turn counterclockwise
-const int BWD = 5; //reverse
-const int STOP = 6; //stop the motors
-const int RLEFT = 7; //reverse left
-const int RRIGHT = 8; //reverse right
+const unsigned long timeout = 3000000ul; //longest wait for the sensors (us)
 
 //Local Function Prototypes
+void idleFor (unsigned long micro);
 void initTimer (void);
 void delay (unsigned long milli);
+unsigned long millis (void);
+unsigned long micros (void);
+void initMotors (void);
+void setDuty (int leftSpeed, int rightSpeed);
+void initBattery (void);
+void measureBattery (void);
+void checkBattery (void);
+unsigned long batteryTime (unsigned long milli);
+void initSensors (void);
+int irRead (int sensor);
+int loadSensors (void);
+int calibrateSensors (int save);
+void steer (int direction);
+void steerTo (int position);
+int linePosition (void);
+int loadTrim (int leftDefault, int rightDefault);
+void waitForButton (int led);
+int calibrateTrim (unsigned long milli);
+void digitalWrite (int pin, int power);
+unsigned long deadlineIn (unsigned long micro);
+int deadlineReached (unsigned long deadline);
 
 //main function
 int main ()
@@ -52,19 +73,35 @@ int main ()
     initTimer(); //initialize peripherals
     TRISB=0; //PORTB all outputs
     LATB=0; // initialize PORTB
+    initMotors(); //L293 inputs low, PWM on the enable pins
+    loadTrim(100, 100); //saved wheel trim, or these if none is saved
+    initBattery(); //ADC on, first battery reading
     TRISA=0xFF; //PORTA all [digital] inputs
     ANSA=0; //all digital inputs
+    initSensors(); //IR sensors analog with ANALOG_IR
+    loadSensors(); //saved IR thresholds, if there are any
+    //button held at reset, calibrate on a straight line
+    if(digitalRead(2)){
+        calibrateSensors(1); //IR thresholds, kept in the EEPROM
+        waitForButton(indicator); //LED flashes: square the robot on the line, then press
+        calibrateTrim(CALIBRATE_TIME); //wheel trim
+    }
 
     //local variables
     int finish = 0; //determine far line (finish) or starting line
     int pressed = 0; //used for positive edge
+    unsigned long deadline; //timeout for loops that wait on the sensors
     int unpressed = 0; //used for negative edge toggle on/off the motors
     int start = 0; //start line indicator
 
     while(1){//repeat forever and read inputs
+        LATENCY_PASS(); //time stamp this pass
+        checkBattery(); //read the battery again every second
+
         //if the switch was pressed and motors are off
         if(digitalRead(2) && !pressed && !unpressed){
             pressed = 1; //positive edge (wait)
+            measureBattery(); //scale the run for the battery as it is now
             finish = 0; //reset finish (far) line indicator
             start = 0; //reset start line indicator
         }
@@ -76,33 +113,51 @@ int main ()
 
             //move from start line
             if(start == 0){
-                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2) && !deadlineReached(deadline)){
                     drive(FWD);
                 }
                 start = 1; //start line cleared
             }
 
             //If robot on line, move forward
-            if(digitalRead(left) && digitalRead(right)) drive(FWD);
+            if(digitalRead(left) && digitalRead(right)){
+                LATENCY_BRANCH(BRANCH_ON_LINE);
+#ifdef POSITION_STEERING
+                steerTo(linePosition()); //correct before either sensor leaves the line
+#else
+                drive(FWD);
+#endif
+            }
 
             //If robot right of line, turn left
-            else if(!digitalRead(left) && digitalRead(right)) drive(CCW);
+            else if(!digitalRead(left) && digitalRead(right)){
+                LATENCY_BRANCH(BRANCH_TURN_LEFT);
+                steer(CCW); //slow the inside wheel more the longer the line is lost
+            }
 
             //If robot left of line, turn right
-            else if(digitalRead(left) && !digitalRead(right)) drive(CW);
+            else if(digitalRead(left) && !digitalRead(right)){
+                LATENCY_BRANCH(BRANCH_TURN_RIGHT);
+                steer(CW); //slow the inside wheel more the longer the line is lost
+            }
 
             //If robot reaches far line, turn around
             else if(!digitalRead(left) && !digitalRead(right) && !finish){
+                LATENCY_BRANCH(BRANCH_BLACK);
                 //keep turning ccs while on the black line
-                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2) && !deadlineReached(deadline)){
                     drive(CCW);
                 }
                 //keep turning while the left sensor is off the line
-                while(digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while(digitalRead(left) && !digitalRead(right) && !digitalRead(2) && !deadlineReached(deadline)){
                     drive(CCW);
                 }
                 //keep turning while both sensors are in white area
-                while(digitalRead(left) && digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while(digitalRead(left) && digitalRead(right) && !digitalRead(2) && !deadlineReached(deadline)){
                     drive(CCW);
                 }
                 finish = 1; //turn complete
@@ -110,6 +165,7 @@ int main ()
 
             //If robot returns to start line, exit program
             else if(!digitalRead(left) && !digitalRead(right) && finish){
+                LATENCY_BRANCH(BRANCH_BLACK);
                 drive(STOP);
                 pressed = 0;
             }
@@ -128,68 +184,11 @@ int main ()
             finish = 0; //reset finish (far) line indicator
             start = 0; //reset start line indicator
             digitalWrite(indicator, 0); //incating motors are off
+            idleFor(1000ul); //sleep until the next tick, then read the switch again
         }
     }//end while
 }//end main
 
-//drives the robot in a direction
-void drive(int direction){
-    if(direction == FWD){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == LEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RIGHT){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == CW){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == CCW){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == BWD){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == STOP){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RLEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == RRIGHT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-}//end drive
-
 //This function assigns a state to pins RB6 to RB15
 void digitalWrite(int pin, int power){
     switch(pin){
@@ -230,10 +229,10 @@ void digitalWrite(int pin, int power){
 int digitalRead(int pin){
     switch(pin){
         case 0:
-            return PORTAbits.RA0;
+            return irRead(0); //digital or analog, see irsensor.h
         break;
         case 1:
-            return PORTAbits.RA1;
+            return irRead(1); //digital or analog, see irsensor.h
         break;
         case 2:
             return PORTAbits.RA2;
@@ -0,0 +1,142 @@
+//latency.h
+/*********************************************************************
+ This contains all functions that measure how long each pass of the
+ main loop takes, from reading the sensors to setting the motors. A
+ program run by the scheduler times its control task instead, with
+ LATENCY_START() and LATENCY_END(), so the idle time between tasks is
+ not counted. Define LATENCY_HIST in the project's preprocessor
+ macros to turn it on; otherwise the macros compile to nothing.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+//branch of the main loop that a pass went through
+#define BRANCH_IDLE 0 //motors off or no branch taken
+#define BRANCH_ON_LINE 1 //both sensors on the line, forward
+#define BRANCH_BLACK 2 //horizontal black line
+#define BRANCH_TURN_LEFT 3 //robot right of line, correcting left
+#define BRANCH_TURN_RIGHT 4 //robot left of line, correcting right
+#define BRANCH_MANEUVER 5 //timed manoeuvre in progress
+
+#ifdef LATENCY_HIST
+
+#define LATENCY_BUCKETS 24 //bucket n holds passes of 2^n to 2^(n+1)-1 us
+
+#define LATENCY_PASS() latencyPass()
+#define LATENCY_START() latencyStart()
+#define LATENCY_END() latencyEnd()
+#define LATENCY_BRANCH(branch) (passBranch = (branch))
+
+//	Global Variables
+/********************************************************************/
+
+//results, read with the debugger
+unsigned int latencyHist[LATENCY_BUCKETS]; //number of passes in each bucket
+unsigned long latencyWorst = 0; //longest pass (us)
+int latencyWorstBranch = BRANCH_IDLE; //branch taken in the longest pass
+
+unsigned long passStart = 0; //ticks() at the start of this pass
+int passBranch = BRANCH_IDLE; //branch taken in this pass
+int passStarted = 0; //set once the first pass has started
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        latencyEnd
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the pass that just ended is added to the histogram
+ *
+ * Overview:  Call through LATENCY_END() where a pass ends. The time since
+ *            latencyStart is counted in the log2 bucket for its length in
+ *            microseconds, and if it is the longest so far it is kept with
+ *            the branch set by LATENCY_BRANCH() during that pass.
+ *
+ * Note:      Bucket counts stop at 65535 instead of wrapping. Does nothing
+ *            if no pass has started.
+ ******************************************************************************/
+
+void latencyEnd (void)
+{
+        unsigned long length;
+        unsigned long rest;
+        int bucket = 0;
+
+        if(!passStarted) return;
+        length = (ticks() - passStart) / TICKS_PER_US;
+
+    //log2 of the length picks the bucket
+        rest = length;
+        while((rest >>= 1) && bucket < LATENCY_BUCKETS - 1) bucket++;
+        if(latencyHist[bucket] < 0xFFFF) latencyHist[bucket]++;
+
+        if(length > latencyWorst){
+            latencyWorst = length;
+            latencyWorstBranch = passBranch;
+        }
+        passStarted = 0;
+} //end latencyEnd
+
+/*******************************************************************************
+ * Function:        latencyStart
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Call through LATENCY_START() where a pass begins. Time stamps
+ *            it and clears the branch.
+ *
+ * Note:
+ ******************************************************************************/
+
+void latencyStart (void)
+{
+        passStart = ticks();
+        passBranch = BRANCH_IDLE;
+        passStarted = 1;
+} //end latencyStart
+
+/*******************************************************************************
+ * Function:        latencyPass
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the pass that just ended is added to the histogram
+ *
+ * Overview:  Call at the top of the main loop through LATENCY_PASS(). Ends
+ *            the pass before, so its length is the time since the last
+ *            call, and starts the next.
+ *
+ * Note:
+ ******************************************************************************/
+
+void latencyPass (void)
+{
+        latencyEnd();
+        latencyStart();
+} //end latencyPass
+
+#else
+
+#define LATENCY_PASS()
+#define LATENCY_START()
+#define LATENCY_END()
+#define LATENCY_BRANCH(branch)
+
+#endif
@@ -3,47 +3,67 @@
  * Author: Daniel Liang
  * Date: 2016/12/02
  * Purpose: The second line following courses
- * PIC used: PIC24F32KA302 operating at 8MHz
+ * PIC used: PIC24F32KA302 operating at 8MHz (32MHz with USE_FRCPLL)
  * I/O ports used and hardware attached:
  * RB15 connected to blue LED
  * RA0 connected to pushbutton
  * RA0 connected to first IR sensor
  * RA1 connected to second IR sensor
+ * RA3, RB4, RB13, RB14, RB0, RB1 connected to extra IR sensors (IR_SENSORS)
+ * RB5 connected to the IR emitters through a transistor (MODULATED_IR)
+ * RB12 connected to the motor battery through a 10k/10k divider
  * L293:
- * pin 2 to RB15
- * pin 7 to RB14
- * pin 10 to RB13
- * pin 13 to RB12
+ * pin 1 to OC1 (left wheel PWM)
+ * pin 9 to OC2 (right wheel PWM)
+ * pin 2 to RB9 (1A, left wheel)
+ * pin 7 to RB8 (2A, left wheel)
+ * pin 10 to RB6 (3A, right wheel)
+ * pin 15 to RB7 (4A, right wheel)
 */
 
 //Include Files
 #include "p24F32KA302.h"
 #include "configBits.h"
+#include "power.h"
 #include "delay.h"
+#include "motor.h"
+#include "eeprom.h"
+#include "adc.h"
+#include "battery.h"
+#include "irsensor.h"
+#include "trim.h"
+#include "latency.h"
 
 //constants for pins
-const int LF = 9; //Left red 1A
-const int LR = 8; //left green 2A
-const int RF = 6; //Right red 3A
-const int RR = 7; //Right green 4A
 const int left = 0; //left sensor
 const int right = 1; //right sensor
 const int indicator = 15; //indicator of robot
-
-//constants for direction of robot
-const int FWD = 0; //go forward
-const int LEFT = 1; //turn left
-const int RIGHT = 2; //turn right
-const int CW = 3; //turn clockwise
-const int CCW = 4; //turn counterclockwise
-const int BWD = 5; //reverse
-const int STOP = 6; //stop the motors
-const int RLEFT = 7; //reverse left
-const int RRIGHT = 8; //reverse right
+const unsigned long timeout = 3000000ul; //longest wait for the sensors (us)
 
 //Local Function Prototypes
+void idleFor (unsigned long micro);
 void initTimer (void);
 void delay (unsigned long milli);
+unsigned long millis (void);
+unsigned long micros (void);
+void initMotors (void);
+void setDuty (int leftSpeed, int rightSpeed);
+void steerTo (int position);
+int linePosition (void);
+void initBattery (void);
+void measureBattery (void);
+void checkBattery (void);
+unsigned long batteryTime (unsigned long milli);
+void initSensors (void);
+int irRead (int sensor);
+int loadSensors (void);
+int calibrateSensors (int save);
+int loadTrim (int leftDefault, int rightDefault);
+void waitForButton (int led);
+int calibrateTrim (unsigned long milli);
+void digitalWrite (int pin, int power);
+unsigned long deadlineIn (unsigned long micro);
+int deadlineReached (unsigned long deadline);
 
 //main function
 int main ()
@@ -52,19 +72,33 @@ int main ()
     initTimer(); //initialize peripherals
     TRISB=0; //PORTB all outputs
     LATB=0; // initialize PORTB
+    initMotors(); //L293 inputs low, PWM on the enable pins
+    loadTrim(86, 100); //saved wheel trim, or these if none is saved
+    initBattery(); //ADC on, first battery reading
     TRISA=0xFF; //PORTA all [digital] inputs
     ANSA=0; //all digital inputs
+    initSensors(); //IR sensors analog with ANALOG_IR
+    loadSensors(); //saved IR thresholds, if there are any
+    //button held at reset, calibrate on a straight line
+    if(digitalRead(2)){
+        calibrateSensors(1); //IR thresholds, kept in the EEPROM
+        waitForButton(indicator); //LED flashes: square the robot on the line, then press
+        calibrateTrim(CALIBRATE_TIME); //wheel trim
+    }
 
     //local variables
     int pressed = 0; //used for positive edge
+    unsigned long deadline; //timeout for loops that wait on the sensors
     int sequence = 1; //used for choosing motor sequence
     int unpressed = 0; //used for negative edge toggle on/off the motors
     int rcount = 0; //right sensor trigger counter
     int lcount = 0; //left sensor trigger counter
     int rucount = 0; //clockwise u-turn counter
-    int fcount = 0; //milliseconds moving forward counter for trimming
 
     while(1){//repeat forever and read inputs
+        LATENCY_PASS(); //time stamp this pass
+        checkBattery(); //read the battery again every second
+
         //if the switch was pressed and motors are off
         if(digitalRead(2) && !pressed && !unpressed){
             while(digitalRead(2)){
@@ -91,6 +125,7 @@ int main ()
                 }
             }
             pressed = 1; //positive edge (wait)
+            measureBattery(); //scale the run for the battery as it is now
         }
 
         //when the switch is released, negative edge trigger
@@ -100,35 +135,40 @@ int main ()
 
             //If robot on line, move forward
             if(digitalRead(left) && digitalRead(right)){
-                fcount++; //counter for number of milliseconds
-                //slow down left motor to 85.7% speed (trimming)
-                if((fcount % 7) == 0) drive(LEFT);
-                else drive(FWD);
-                delay(1);
+                LATENCY_BRANCH(BRANCH_ON_LINE);
+#ifdef POSITION_STEERING
+                steerTo(linePosition()); //correct before either sensor leaves the line
+#else
+                drive(FWD); //wheels trimmed by loadTrim
+#endif
             }
 
             //If robot at start line, move forward
             else if(!digitalRead(left) && !digitalRead(right)){
+                LATENCY_BRANCH(BRANCH_BLACK);
                 drive(FWD);
-                delay(100);
+                delay(batteryTime(100));
             }
 
             //If robot right of line, turn left (sequence 0)
             else if(!digitalRead(left) && digitalRead(right) && !sequence){
+                LATENCY_BRANCH(BRANCH_TURN_LEFT);
                 //at last clockwise u-turn, make a sharp left
                 if(rucount > 20 && pressed){
                     drive(FWD);
-                    delay(100);
+                    delay(batteryTime(100));
                     drive(LEFT);
-                    delay(1700);
+                    delay(batteryTime(1700));
                     //reverse park at finish line
-                    while(digitalRead(left) && digitalRead(right)) drive(BWD);
+                    deadline = deadlineIn(timeout);
+                    while(digitalRead(left) && digitalRead(right) && !deadlineReached(deadline)) drive(BWD);
                     pressed = 0; //exit program
                 }
 
                 //turn CCW until both sensors see white
                 else{
-                    while(!digitalRead(left) || !digitalRead(right) && !digitalRead(2)){
+                    deadline = deadlineIn(timeout);
+                    while((!digitalRead(left) || !digitalRead(right) && !digitalRead(2)) && !deadlineReached(deadline)){
                         drive(CCW);
                     }
                 }
@@ -137,12 +177,13 @@ int main ()
 
             //If robot left of line, turn right (sequence 0)
             else if(digitalRead(left) && !digitalRead(right) && !sequence){
+                LATENCY_BRANCH(BRANCH_TURN_RIGHT);
                 //at first right turn, steer right 90 degrees
                 if(rcount == 3){
                     drive(FWD);
-                    delay(450);
+                    delay(batteryTime(450));
                     drive(RIGHT);
-                    delay(1150);
+                    delay(batteryTime(1150));
                 }
 
                 //turn CW until both sensor see white
@@ -150,7 +191,8 @@ int main ()
                     /*while(digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
                         drive(CW);
                     }*/
-                    while(!digitalRead(left) || !digitalRead(right) && !digitalRead(2)){
+                    deadline = deadlineIn(timeout);
+                    while((!digitalRead(left) || !digitalRead(right) && !digitalRead(2)) && !deadlineReached(deadline)){
                         drive(CW);
                     }
                 }
@@ -160,8 +202,10 @@ int main ()
 
             //If robot right of line, turn left (sequence 1)
             else if(!digitalRead(left) && digitalRead(right) && sequence){
+                LATENCY_BRANCH(BRANCH_TURN_LEFT);
                 //turn CCW until both sensor see white
-                while(!digitalRead(left) || !digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while((!digitalRead(left) || !digitalRead(right) && !digitalRead(2)) && !deadlineReached(deadline)){
                     drive(CCW);
                 }
                 rucount = 0; //reset right u-turn counter
@@ -169,20 +213,23 @@ int main ()
 
             //If robot left of line, turn right (sequence 1)
             else if(digitalRead(left) && !digitalRead(right) && sequence){
+                LATENCY_BRANCH(BRANCH_TURN_RIGHT);
                 //at last clockwise u-turn rotate into position
                 if(rucount == 8){
                     drive(FWD);
-                    delay(250);
+                    delay(batteryTime(250));
                     drive(RIGHT);
-                    delay(850);
+                    delay(batteryTime(850));
                     //reverse park at finish line
-                    while(digitalRead(left) && digitalRead(right)) drive(BWD);
+                    deadline = deadlineIn(timeout);
+                    while(digitalRead(left) && digitalRead(right) && !deadlineReached(deadline)) drive(BWD);
                     pressed = 0;
                 }
 
                 //keep turning CW until both sensor see white
                 else{
-                    while(!digitalRead(left) || !digitalRead(right) && !digitalRead(2)){
+                    deadline = deadlineIn(timeout);
+                    while((!digitalRead(left) || !digitalRead(right) && !digitalRead(2)) && !deadlineReached(deadline)){
                         drive(CW);
                     }
                 }
@@ -199,75 +246,17 @@ int main ()
         if(!digitalRead(2) && !pressed){
             drive(STOP);
             unpressed = 0; //motors are off
-            fcount = 0; //reset forward trim counter
             sequence = 1; //reset sequence selection
             //reset all turning counters
             rcount = 0;
             lcount = 0;
             rucount = 0;
             digitalWrite(indicator, 0); //incating motors are off
+            idleFor(1000ul); //sleep until the next tick, then read the switch again
         }   
     }//end while
 }//end main
 
-//drives the robot in a direction
-void drive(int direction){
-    if(direction == FWD){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == LEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RIGHT){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == CW){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == CCW){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == BWD){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == STOP){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RLEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == RRIGHT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-}//end drive
-
 //This function assigns a state to pins RB6 to RB15
 void digitalWrite(int pin, int power){
     switch(pin){
@@ -308,10 +297,10 @@ void digitalWrite(int pin, int power){
 int digitalRead(int pin){
     switch(pin){
         case 0:
-            return PORTAbits.RA0;
+            return irRead(0); //digital or analog, see irsensor.h
         break;
         case 1:
-            return PORTAbits.RA1;
+            return irRead(1); //digital or analog, see irsensor.h
         break;
         case 2:
             return PORTAbits.RA2;
@@ -0,0 +1,206 @@
+//adc.h
+/*********************************************************************
+ This contains all functions that deal with the 12 bit ADC. Single
+ readings are taken on request. The sensor channels can also be
+ scanned in the background, with one interrupt per full scan that
+ copies the results into a double buffered frame, so reading a
+ sensor never waits on a conversion.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define ADC_SCAN 0x0003 //channels scanned in the background unless set (AN0 and AN1)
+#define ADC_MAX 8 //most channels one scan can hold
+
+//	Global Variables
+/********************************************************************/
+
+//results of one full scan, in channel order
+struct adcFrame {
+        unsigned int value[ADC_MAX]; //reading of each scanned channel
+        unsigned int number; //counts up by one for each scan
+};
+
+volatile struct adcFrame adcFrames[2]; //one is filled while the other is read
+volatile int adcLatest = 0; //frame holding the newest full scan
+int adcScanning = 0; //set while the background scan is running
+unsigned int adcScan = ADC_SCAN; //channels scanned in the background (bit n for ANn)
+int adcChannels = 0; //number of channels in adcScan, counted by setAdc
+void (*adcHook)(void) = 0; //optional function run after each full scan
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        setAdc
+ *
+ * PreCondition:    -
+ *
+ * Input:           1 to scan adcScan in the background, 0 for single readings
+ *
+ * Output:          none
+ *
+ * Side Effects:    the ADC is turned off and on again, any conversion in
+ *                  progress is lost
+ *
+ * Overview:  Sets up the ADC for 12 bit results against AVdd and AVss, with
+ *            the band-gap reference on. In scan mode the ADC samples and
+ *            converts on its own, one channel after the other, and
+ *            interrupts after the last one. Set adcScan first to scan other
+ *            channels; only the lowest ADC_MAX of them are kept.
+ *
+ * Note:      Tad is 10 Tcy, which is 2.5us at 4MHz and 625ns with
+ *            USE_FRCPLL, both above the 600ns minimum. A scanned channel is
+ *            sampled for 31 Tad, so each channel adds about 112us to a scan
+ *            at 4MHz (28us with USE_FRCPLL).
+ ******************************************************************************/
+
+void setAdc (int scan)
+{
+        int i;
+
+        AD1CON1 = 0;		//Turn off the ADC while it is configured
+        IEC0bits.AD1IE = 0;
+        AD1CON1bits.MODE12 = 1;	//12 bit results
+        AD1CON1bits.SSRC = 7;	//convert once the sample time is over
+        AD1CON2 = 0;		//AVdd and AVss as references
+        AD1CON3 = 0;
+        AD1CON3bits.ADCS = 9;	//Tad of 10 Tcy
+        AD1CON5 = 0;
+        AD1CON5bits.BGREQ = 1;	//keep the band-gap on for the ADC
+
+        if(scan){
+            AD1CSSL = 0;
+            adcChannels = 0;
+            for(i = 0; i < 16 && adcChannels < ADC_MAX; i++){
+                if(adcScan & (1u << i)){
+                    AD1CSSL |= 1u << i;
+                    adcChannels++;
+                }
+            }
+            AD1CON2bits.CSCNA = 1;	//scan the channels in AD1CSSL
+            AD1CON2bits.SMPI = adcChannels - 1;	//interrupt after each scan
+            AD1CON3bits.SAMC = 31;	//sample for 31 Tad
+            AD1CON1bits.ASAM = 1;	//start sampling again after each conversion
+            IFS0bits.AD1IF = 0;	// Clear out the ADC flag
+            IEC0bits.AD1IE = 1;	// Enable the ADC interrupt
+        }
+        else{
+            AD1CSSL = 0;
+            AD1CON3bits.SAMC = 12;	//sample for 12 Tad
+        }
+
+        adcScanning = scan;
+        AD1CON1bits.ADON = 1;
+} //end setAdc
+
+/*******************************************************************************
+ * Function:        initAdc
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the ADC is turned on
+ *
+ * Overview:  Turns on the ADC for single readings with readAdc.
+ *
+ * Note:
+ ******************************************************************************/
+
+void initAdc (void)
+{
+        setAdc(0);
+} //end initAdc
+
+/*******************************************************************************
+ * Function:        readAdc
+ *
+ * PreCondition:    initAdc has been called
+ *
+ * Input:           ADC channel (0 to 15 for AN0 to AN15, or an internal one)
+ *
+ * Output:          12 bit result
+ *
+ * Side Effects:    a background scan is stopped for the reading and started
+ *                  again with the next scan
+ *
+ * Overview:  Samples one channel and waits for the conversion, about 30us.
+ *
+ * Note:      Used for slow readings such as the battery. Read the sensors
+ *            from the scan instead.
+ ******************************************************************************/
+
+unsigned int readAdc (int channel)
+{
+        int scanning = adcScanning;
+        unsigned int result;
+
+        if(scanning) setAdc(0);
+
+        AD1CHS = channel;
+        AD1CON1bits.DONE = 0;
+        AD1CON1bits.SAMP = 1;	//sample, then convert on its own
+        while(!AD1CON1bits.DONE);
+        result = ADC1BUF0;
+
+        if(scanning) setAdc(1);
+        return result;
+} //end readAdc
+
+/*******************************************************************************
+ * Function:        _ADC1Interrupt
+ *
+ * PreCondition:    setAdc(1) has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the frame not in use is filled and becomes the latest
+ *
+ * Overview:  ADC interrupt service routine. Runs once per full scan and
+ *            copies the results from ADC1BUF0 on into the frame that is not
+ *            being read, then makes it the latest. Runs adcHook if one is
+ *            set.
+ *
+ * Note:      adcHook runs inside the interrupt and must be short.
+ ******************************************************************************/
+
+void __attribute__((__interrupt__, no_auto_psv)) _ADC1Interrupt (void)
+{
+        int frame = !adcLatest;
+        int i;
+
+        for(i = 0; i < adcChannels; i++) adcFrames[frame].value[i] = (&ADC1BUF0)[i];
+        adcFrames[frame].number = adcFrames[adcLatest].number + 1;
+        adcLatest = frame;
+        if(adcHook) adcHook();
+
+        IFS0bits.AD1IF = 0;
+} //end _ADC1Interrupt
+
+/*******************************************************************************
+ * Function:        adcValue
+ *
+ * PreCondition:    setAdc(1) has been called
+ *
+ * Input:           place of the channel in the scan (0 for the lowest channel
+ *                  in adcScan)
+ *
+ * Output:          12 bit result from the newest full scan
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Takes a reading from the latest frame without waiting.
+ *
+ * Note:
+ ******************************************************************************/
+
+unsigned int adcValue (int slot)
+{
+        return adcFrames[adcLatest].value[slot];
+} //end adcValue
@@ -0,0 +1,79 @@
+//encoders.h
+/*********************************************************************
+ This contains all functions that catch the wheel encoder edges on
+ RB2 (left) and RB3 (right) with change notification interrupts and
+ pass them on to the counts in odometry.h
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define ENCODER_BITS 0x000C //RB2 (left) and RB3 (right) in PORTB
+
+//	Global Variables
+/********************************************************************/
+
+unsigned int encoderBits = 0; //encoder bits after the last edge
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        encoderEdge
+ *
+ * PreCondition:    initOdometry has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the encoder counts change
+ *
+ * Overview:  Runs from the CN interrupt through cnHook. Counts an edge for
+ *            each encoder pin that changed since the last interrupt.
+ *
+ * Note:
+ ******************************************************************************/
+
+void encoderEdge (void)
+{
+        unsigned int bits = PORTB & ENCODER_BITS;
+        unsigned int changed = bits ^ encoderBits;
+
+        if(changed & 0x0004) countEncoder(0);
+        if(changed & 0x0008) countEncoder(1);
+        encoderBits = bits;
+} //end encoderEdge
+
+/*******************************************************************************
+ * Function:        initOdometry
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    RB2 and RB3 become digital inputs, change notification
+ *                  interrupt is enabled
+ *
+ * Overview:  Sets up the encoder pins, clears the counts and enables change
+ *            notification on CN6 (RB2) and CN7 (RB3).
+ *
+ * Note:      Call after PORTB is set as outputs, since it makes RB2 and RB3
+ *            inputs again.
+ ******************************************************************************/
+
+void initOdometry (void)
+{
+        ANSB &= ~ENCODER_BITS;	//digital inputs
+        TRISB |= ENCODER_BITS;
+        encoderBits = PORTB & ENCODER_BITS; //state before the first edge
+        resetOdometry();
+
+        cnHook = encoderEdge;
+        CNEN1bits.CN6IE = 1;	// interrupt on RB2 changes
+        CNEN1bits.CN7IE = 1;	// interrupt on RB3 changes
+        IFS1bits.CNIF = 0;	// Clear out the CN flag
+        IEC1bits.CNIE = 1;	// Enable the CN interrupt
+} //end initOdometry
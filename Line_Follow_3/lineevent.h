@@ -0,0 +1,127 @@
+//lineevent.h
+/*********************************************************************
+ This contains all functions that turn the two IR sensor readings
+ into one LINE_ENTER and one LINE_EXIT event for each horizontal
+ black line, so a line is never counted twice and nothing has to
+ wait for the robot to get off it
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+//events returned by lineEvent
+#define LINE_NONE 0 //nothing new
+#define LINE_ENTER 1 //both sensors have reached a black line
+#define LINE_EXIT 2 //the robot has left the black line
+
+#define ENTER_HOLD 2ul //time both sensors must read black to enter a line (ms)
+#define EXIT_HOLD 5ul //time off black needed to leave a line (ms)
+#define LINE_GAP 20ul //time after leaving a line before another can be entered (ms)
+#define LINE_GAP_MM 10l //distance after leaving a line before another can be entered (mm)
+#define LINE_GAP_WAIT 250ul //time with no encoder movement before a stalled robot re-arms (ms)
+
+//	Global Variables
+/********************************************************************/
+
+int onBlack = 0; //set between LINE_ENTER and LINE_EXIT
+int lineArmed = 1; //cleared from LINE_EXIT until the gap has passed
+int lineRaw = 0; //1 while both sensors read black
+unsigned long lineRawSince = 0; //millis() when lineRaw last changed
+unsigned long lineExitTime = 0; //millis() at the last LINE_EXIT
+long lineExitMm = 0; //odometryDistance() at the last LINE_EXIT
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        lineEvent
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           left and right sensor readings (1 on the line, 0 over
+ *                  black)
+ *
+ * Output:          LINE_ENTER, LINE_EXIT or LINE_NONE
+ *
+ * Side Effects:    onBlack, lineArmed, lineRaw and lineRawSince are updated,
+ *                  and lineExitTime and lineExitMm on LINE_EXIT
+ *
+ * Overview:  Call on every pass that steers the robot. Both sensors must
+ *            read black for ENTER_HOLD ms to enter a line, and the robot
+ *            must be off black for EXIT_HOLD ms to leave it. After leaving,
+ *            the next line is only entered once LINE_GAP ms have passed and
+ *            the robot has gone LINE_GAP_MM, so the ragged edge of the tape
+ *            cannot start a second crossing, even when the robot crawls
+ *            off a line. Until an encoder edge has ever been counted (none
+ *            fitted, or initOdometry not called) LINE_GAP is used on its
+ *            own. If the encoders have counted before but not since the
+ *            line, the robot is taken to have stalled and re-arms after
+ *            LINE_GAP_WAIT ms.
+ *
+ * Note:      Call resetLineEvent instead on passes that do not call it (for
+ *            example while a manoeuvre is running), or the line state goes
+ *            stale and a line reached as the manoeuvre ends is missed.
+ ******************************************************************************/
+
+int lineEvent (int leftOn, int rightOn)
+{
+        unsigned long now = millis();
+        int black = !leftOn && !rightOn;
+        long moved;
+
+        if(black != lineRaw){
+            lineRaw = black;
+            lineRawSince = now;
+        }
+
+    //the gap after the last line is over
+        if(!lineArmed && !onBlack){
+            moved = odometryDistance() - lineExitMm;
+            if(moved < 0) moved = -moved;
+            if(now - lineExitTime >= LINE_GAP){
+                if(!encoderSeen || moved >= LINE_GAP_MM) lineArmed = 1;
+                else if(moved == 0 && now - lineExitTime >= LINE_GAP_WAIT) lineArmed = 1;
+            }
+        }
+
+        if(!onBlack && lineArmed && lineRaw && now - lineRawSince >= ENTER_HOLD){
+            onBlack = 1;
+            return LINE_ENTER;
+        }
+
+        if(onBlack && !lineRaw && now - lineRawSince >= EXIT_HOLD){
+            onBlack = 0;
+            lineArmed = 0;
+            lineExitTime = now;
+            lineExitMm = odometryDistance();
+            return LINE_EXIT;
+        }
+
+        return LINE_NONE;
+} //end lineEvent
+
+/*******************************************************************************
+ * Function:        resetLineEvent
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Forgets any line in progress and any gap after one. Used when
+ *            the program is stopped with the push button, and on every pass
+ *            while a manoeuvre runs, so the first call after it starts
+ *            again from the sensors as they are then.
+ *
+ * Note:
+ ******************************************************************************/
+
+void resetLineEvent (void)
+{
+        onBlack = 0;
+        lineArmed = 1;
+        lineRaw = 0;
+} //end resetLineEvent
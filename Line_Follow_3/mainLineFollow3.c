@@ -3,47 +3,82 @@
  * Author: Daniel Liang
  * Date: 2016/12/19
  * Purpose: The third line following course
- * PIC used: PIC24F32KA302 operating at 8MHz
+ * PIC used: PIC24F32KA302 operating at 8MHz (32MHz with USE_FRCPLL)
  * I/O ports used and hardware attached:
  * RB15 connected to blue LED
  * RA0 connected to pushbutton
  * RA0 connected to first IR sensor
  * RA1 connected to second IR sensor
+ * RA3, RB4, RB13, RB14, RB0, RB1 connected to extra IR sensors (IR_SENSORS)
+ * RB2 connected to left wheel encoder
+ * RB3 connected to right wheel encoder
+ * RB5 connected to the IR emitters through a transistor (MODULATED_IR)
+ * RB12 connected to the motor battery through a 10k/10k divider
  * L293:
- * pin 2 to RB15
- * pin 7 to RB14
- * pin 10 to RB13
- * pin 13 to RB12
+ * pin 1 to OC1 (left wheel PWM)
+ * pin 9 to OC2 (right wheel PWM)
+ * pin 2 to RB9 (1A, left wheel)
+ * pin 7 to RB8 (2A, left wheel)
+ * pin 10 to RB6 (3A, right wheel)
+ * pin 15 to RB7 (4A, right wheel)
 */
 
 //Include Files
 #include "p24F32KA302.h"
 #include "configBits.h"
+#include "power.h"
 #include "delay.h"
+#include "motor.h"
+#include "eeprom.h"
+#include "adc.h"
+#include "battery.h"
+#include "irsensor.h"
+#include "trim.h"
+#include "latency.h"
+#include "edges.h"
+#include "odometry.h"
+#include "encoders.h"
+#include "lineevent.h"
+#include "maneuver.h"
 
 //constants for pins
-const int LF = 9; //Left red 1A
-const int LR = 8; //left green 2A
-const int RF = 6; //Right red 3A
-const int RR = 7; //Right green 4A
 const int left = 0; //left sensor
 const int right = 1; //right sensor
 const int indicator = 15; //indicator of robot
-
-//constants for direction of robot
-const int FWD = 0; //go forward
-const int LEFT = 1; //turn left
-const int RIGHT = 2; //turn right
-const int CW = 3; //turn clockwise
-const int CCW = 4; //turn counterclockwise
-const int BWD = 5; //reverse
-const int STOP = 6; //stop the motors
-const int RLEFT = 7; //reverse left
-const int RRIGHT = 8; //reverse right
+const unsigned long timeout = 3000000ul; //longest wait for the sensors (us)
 
 //Local Function Prototypes
+void idleFor (unsigned long micro);
 void initTimer (void);
 void delay (unsigned long milli);
+unsigned long millis (void);
+unsigned long micros (void);
+void initMotors (void);
+void setDuty (int leftSpeed, int rightSpeed);
+void initBattery (void);
+void measureBattery (void);
+void checkBattery (void);
+unsigned long batteryTime (unsigned long milli);
+void initSensors (void);
+int irRead (int sensor);
+int loadSensors (void);
+int calibrateSensors (int save);
+void steer (int direction);
+void steerTo (int position);
+int linePosition (void);
+int loadTrim (int leftDefault, int rightDefault);
+void waitForButton (int led);
+int calibrateTrim (unsigned long milli);
+void digitalWrite (int pin, int power);
+unsigned long deadlineIn (unsigned long micro);
+int deadlineReached (unsigned long deadline);
+void waitPeriod (unsigned long micro);
+void initOdometry (void);
+void queueManeuver (int direction, unsigned long milli, unsigned long arm, int until);
+int maneuverRunning (void);
+int lineEvent (int leftOn, int rightOn);
+void resetLineEvent (void);
+void cancelManeuver (void);
 
 //main function
 int main ()
@@ -52,21 +87,40 @@ int main ()
     initTimer(); //initialize peripherals
     TRISB=0; //PORTB all outputs
     LATB=0; // initialize PORTB
+    initMotors(); //L293 inputs low, PWM on the enable pins
+    loadTrim(90, 100); //saved wheel trim, or these if none is saved
+    initBattery(); //ADC on, first battery reading
     TRISA=0xFF; //PORTA all [digital] inputs
     ANSA=0; //all digital inputs
+    initSensors(); //IR sensors analog with ANALOG_IR
+    loadSensors(); //saved IR thresholds, if there are any
+    //button held at reset, calibrate on a straight line
+    if(digitalRead(2)){
+        calibrateSensors(1); //IR thresholds, kept in the EEPROM
+        waitForButton(indicator); //LED flashes: square the robot on the line, then press
+        calibrateTrim(CALIBRATE_TIME); //wheel trim
+    }
+    initOdometry(); //count wheel encoder edges on RB2 and RB3
 
     //local variables
     int pressed = 0; //used for positive edge
+    unsigned long deadline; //timeout for loops that wait on the sensors
     int unpressed = 0; //used for negative edge toggle on/off the motors
     int start = 0; //start line indicator
     int bcount = 0;
     int tcount = 0;
-    int fcount = 0; //milliseconds moving forward counter for trimming
+    int running; //a manoeuvre is in progress
+    int event; //black line event from the sensors
+    int fcount = 0; //milliseconds moving forward counter
 
     while(1){//repeat forever and read inputs
+        LATENCY_PASS(); //time stamp this pass
+        checkBattery(); //read the battery again every second
+
         //if the switch was pressed and motors are off
         if(digitalRead(2) && !pressed && !unpressed){
             pressed = 1; //positive edge (wait)
+            measureBattery(); //scale the run for the battery as it is now
         }
 
         //when the switch is released, negative edge trigger
@@ -76,43 +130,56 @@ int main ()
 
             //move from start line
             if(start == 0){
-                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
+                deadline = deadlineIn(timeout);
+                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2) && !deadlineReached(deadline)){
                     drive(FWD);
                 }
                 start = 1; //start line cleared
             }
 
+            //black lines are only looked for between manoeuvres
+            running = maneuverRunning();
+            if(running) resetLineEvent(); //start again from the sensors once it ends
+            event = running ? LINE_NONE : lineEvent(digitalRead(left), digitalRead(right));
+
+            //keep turning until the manoeuvre in progress is finished
+            if(running){
+                //the manoeuvre watches the sensors itself
+                LATENCY_BRANCH(BRANCH_MANEUVER);
+            }
+
             //If robot on line, move forward
-            if(digitalRead(left) && digitalRead(right)){
+            else if(digitalRead(left) && digitalRead(right)){
+                LATENCY_BRANCH(BRANCH_ON_LINE);
                 fcount++; //counter for number of milliseconds
-                //slow down left motor to 90% speed (trimming)
-                if((fcount % 10) == 0) drive(LEFT);
-                else drive(FWD);
-                delay(1);
+#ifdef POSITION_STEERING
+                steerTo(linePosition()); //correct before either sensor leaves the line
+#else
+                drive(FWD); //wheels trimmed by loadTrim
+#endif
+                waitPeriod(1000ul); //exactly 1ms per count, idles the rest
             }
 
-            //if robot sees horizontal black line
-            else if(!digitalRead(left) && !digitalRead(right)){
+            //if robot reaches a horizontal black line, once per line
+            else if(event == LINE_ENTER){
+                LATENCY_BRANCH(BRANCH_BLACK);
                 //count black lines after position assignment
                 if(fcount >= 1000) tcount++;
 
                 //count black lines for position assignment
                 if(fcount < 1000){
-                    drive(FWD);
+                    drive(FWD); //keep going, the line is not counted again
                     bcount++;
-                    while(!digitalRead(left) && !digitalRead(right));
                 }
 
                 //first T intersection
                 if(tcount == 1){
                     drive(FWD); delay(1); //wake-up call for PIC
                     if(bcount == 1 || bcount == 3){
-                        drive(LEFT);
-                        delay(800);
+                        queueManeuver(LEFT, 800, 400, UNTIL_LINE);
                     }
                     if(bcount == 2 || bcount == 4){
-                        drive(RIGHT);
-                        delay(800);
+                        queueManeuver(RIGHT, 800, 400, UNTIL_LINE);
                     }
                 }
 
@@ -120,12 +187,10 @@ int main ()
                 if(tcount == 2){
                     drive(FWD); delay(1);
                     if(bcount == 1 || bcount == 3){
-                        drive(RIGHT);
-                        delay(600);
+                        queueManeuver(RIGHT, 600, 300, UNTIL_LINE);
                     }
                     if(bcount == 2 || bcount == 4){
-                        drive(LEFT);
-                        delay(600);
+                        queueManeuver(LEFT, 600, 300, UNTIL_LINE);
                     }
                 }
 
@@ -133,27 +198,22 @@ int main ()
                 if(tcount == 3){
                     drive(FWD); delay(1);
                     if(bcount == 1 || bcount == 4){
-                        drive(RIGHT);
-                        delay(700);
+                        queueManeuver(RIGHT, 700, 350, UNTIL_LINE);
                     }
                     if(bcount == 2 || bcount == 3){
-                        drive(LEFT);
-                        delay(700);
+                        queueManeuver(LEFT, 700, 350, UNTIL_LINE);
                     }
                 }
 
                 //reverse and turn around after hitting position line
                 if(tcount == 4){
                     drive(FWD); delay(1);
-                    drive(BWD);
-                    delay(800);
+                    queueManeuver(BWD, 800, 0, UNTIL_TIME);
                     if(bcount == 1 || bcount == 4){
-                        drive(RIGHT);
-                        delay(800);
+                        queueManeuver(RIGHT, 800, 400, UNTIL_LINE);
                     }
                     else if(bcount == 2 || bcount == 3){
-                        drive(LEFT);
-                        delay(800);
+                        queueManeuver(LEFT, 800, 400, UNTIL_LINE);
                     }
                 }
 
@@ -161,12 +221,10 @@ int main ()
                 if(tcount == 5){
                     drive(FWD); delay(1);
                     if(bcount == 2 || bcount == 4){
-                        drive(LEFT);
-                        delay(900);
+                        queueManeuver(LEFT, 900, 450, UNTIL_LINE);
                     }
                     else if(bcount == 1 || bcount == 3){
-                        drive(RIGHT);
-                        delay(900);
+                        queueManeuver(RIGHT, 900, 450, UNTIL_LINE);
                     }
                 }
 
@@ -174,19 +232,14 @@ int main ()
                 if(tcount == 6){
                     drive(FWD); delay(1);
                     if(bcount == 2 || bcount == 4){
-                        drive(FWD);
-                        delay(300);
-                        drive(RIGHT);
-                        delay(800);
+                        queueManeuver(FWD, 300, 0, UNTIL_TIME);
+                        queueManeuver(RIGHT, 800, 400, UNTIL_LINE);
                     }
                     else if(bcount == 1 || bcount == 3){
-                        drive(FWD);
-                        delay(250);
-                        drive(LEFT);
-                        delay(900);
+                        queueManeuver(FWD, 250, 0, UNTIL_TIME);
+                        queueManeuver(LEFT, 900, 450, UNTIL_LINE);
                     }
-                    drive(FWD);
-                    delay(300);
+                    queueManeuver(FWD, 300, 0, UNTIL_TIME);
                 }
 
                 //stop inside box
@@ -197,12 +250,14 @@ int main ()
 
             //If robot right of line, turn left
             else if(!digitalRead(left) && digitalRead(right) && fcount >= 1000){
-                drive(CCW);
+                LATENCY_BRANCH(BRANCH_TURN_LEFT);
+                steer(CCW); //slow the inside wheel more the longer the line is lost
             }
 
             //If robot left of line, turn right
             else if(digitalRead(left) && !digitalRead(right) && fcount >= 1000){
-                drive(CW);
+                LATENCY_BRANCH(BRANCH_TURN_RIGHT);
+                steer(CW); //slow the inside wheel more the longer the line is lost
             }
         }//end if (motor sequences)
 
@@ -214,74 +269,19 @@ int main ()
         //when the switch is released, negative edge trigger or program is finished
         if(!digitalRead(2) && !pressed){
             drive(STOP);
+            cancelManeuver(); //drop any unfinished turn
+            resetLineEvent(); //forget any line in progress
             unpressed = 0; //motors are off
-            fcount = 0; //reset forward trim counter
+            fcount = 0; //reset forward counter
             bcount = 0; //reset position assigment
             tcount = 0; //reset black line counter
             start = 0; //reset start line indicator
             digitalWrite(indicator, 0); //incating motors are off
+            idleFor(1000ul); //sleep until the next tick, then read the switch again
         }
     }//end while
 }//end main
 
-//drives the robot in a direction
-void drive(int direction){
-    if(direction == FWD){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == LEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RIGHT){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == CW){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == CCW){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == BWD){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == STOP){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-    else if(direction == RLEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
-    }
-    else if(direction == RRIGHT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
-    }
-}//end drive
-
 //This function assigns a state to pins RB6 to RB15
 void digitalWrite(int pin, int power){
     switch(pin){
@@ -322,10 +322,10 @@ void digitalWrite(int pin, int power){
 int digitalRead(int pin){
     switch(pin){
         case 0:
-            return PORTAbits.RA0;
+            return irRead(0); //digital or analog, see irsensor.h
         break;
         case 1:
-            return PORTAbits.RA1;
+            return irRead(1); //digital or analog, see irsensor.h
         break;
         case 2:
             return PORTAbits.RA2;
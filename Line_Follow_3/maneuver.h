@@ -0,0 +1,225 @@
+//maneuver.h
+/*********************************************************************
+ This contains all functions that run timed motor manoeuvres
+ (turns, straightening, reversing) without blocking the main loop
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define MAX_STEPS 4 //most steps that can be queued at once
+#define STEP_TIMEOUT 3000ul //step time for steps that should end on a sensor
+#define RAMP_DOWN 100ul //time at the end of a long step spent slowing down (ms)
+#define PROFILE_MIN 40 //speed at the very end of a long step (%)
+
+//conditions that end a step before its time is up
+#define UNTIL_TIME 0 //run for the full time
+#define UNTIL_LINE 1 //stop once both sensors are back on the line
+#define UNTIL_CLEAR 2 //stop once either sensor is off the black line
+#define UNTIL_DISTANCE 3 //stop once the robot has moved the step's distance
+#define UNTIL_ANGLE 4 //stop once the robot has turned the step's angle
+
+//	Global Variables
+/********************************************************************/
+
+int stepDirection[MAX_STEPS]; //motor command for each step
+unsigned long stepTime[MAX_STEPS]; //longest time for each step (ms)
+unsigned long stepArm[MAX_STEPS]; //time before the exit condition is checked
+int stepUntil[MAX_STEPS]; //exit condition for each step
+long stepTarget[MAX_STEPS]; //distance (mm) or angle (tenths of a degree) to move
+long stepFrom = 0; //odometry reading when the current step started
+int stepCount = 0; //number of steps queued
+int stepIndex = 0; //step currently running
+unsigned long stepStart = 0; //millis() when the current step started
+
+//functions and constants from the main program
+int digitalRead (int pin);
+extern const int left;
+extern const int right;
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        startStep
+ *
+ * PreCondition:    the step has been queued
+ *
+ * Input:           step number
+ *
+ * Output:          none
+ *
+ * Side Effects:    the motors start the step's command
+ *
+ * Overview:  Starts a step and notes the time, and for distance and angle
+ *            steps the odometry reading the step is measured from.
+ *
+ * Note:
+ ******************************************************************************/
+
+void startStep (int step)
+{
+        stepIndex = step;
+        stepStart = millis();
+        if(stepUntil[step] == UNTIL_DISTANCE) stepFrom = odometryDistance();
+        if(stepUntil[step] == UNTIL_ANGLE) stepFrom = odometryHeading();
+        drive(stepDirection[step]);
+} //end startStep
+
+/*******************************************************************************
+ * Function:        queueManeuver
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           motor direction, longest time in milliseconds, time in
+ *                  milliseconds before the exit condition is checked and the
+ *                  exit condition (UNTIL_TIME, UNTIL_LINE or UNTIL_CLEAR)
+ *
+ * Output:          none
+ *
+ * Side Effects:    the motors start moving if no other step is queued
+ *
+ * Overview:  Adds a step to the end of the manoeuvre. The first step starts
+ *            right away; later steps start when the one before them ends.
+ *            The arming time keeps a turn from ending while the sensors are
+ *            still on the line it started from.
+ *
+ * Note:      Steps past MAX_STEPS are ignored. The times are stretched with
+ *            batteryTime for the battery as it is when the step is queued.
+ ******************************************************************************/
+
+void queueManeuver (int direction, unsigned long milli, unsigned long arm, int until)
+{
+        if(stepCount >= MAX_STEPS) return;
+
+        stepDirection[stepCount] = direction;
+        stepTime[stepCount] = batteryTime(milli);
+        stepArm[stepCount] = batteryTime(arm);
+        stepUntil[stepCount] = until;
+        stepCount++;
+
+    //start the motors if this is the only step
+        if(stepCount == 1) startStep(0);
+} //end queueManeuver
+
+/*******************************************************************************
+ * Function:        queueMove
+ *
+ * PreCondition:    initTimer and initOdometry have been called
+ *
+ * Input:           motor direction, distance in millimetres (UNTIL_DISTANCE)
+ *                  or angle in tenths of a degree (UNTIL_ANGLE), and which of
+ *                  the two it is
+ *
+ * Output:          none
+ *
+ * Side Effects:    the motors start moving if no other step is queued
+ *
+ * Overview:  Adds a step that ends when the wheel encoders have measured
+ *            the given distance or angle, either way, instead of after a
+ *            fixed time. This keeps turns the same as the battery runs down
+ *            and on different floors.
+ *
+ * Note:      The step still ends after STEP_TIMEOUT if the encoders do not
+ *            count, so the robot cannot run away.
+ ******************************************************************************/
+
+void queueMove (int direction, long amount, int until)
+{
+        if(stepCount >= MAX_STEPS) return;
+
+        stepTarget[stepCount] = amount;
+        queueManeuver(direction, STEP_TIMEOUT, 0, until);
+} //end queueMove
+
+/*******************************************************************************
+ * Function:        maneuverRunning
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          1 while a manoeuvre is in progress, 0 when it is done
+ *
+ * Side Effects:    the motor command changes when a step ends
+ *
+ * Overview:  Steps the manoeuvre. Call once per pass of the main loop. The
+ *            current step ends when its time is up or, once armed, when its
+ *            exit condition is met. The next step then starts right away.
+ *            Steps at least twice RAMP_DOWN long slow down over their last
+ *            RAMP_DOWN ms; with the ramp up from drive() this gives each
+ *            timed turn a trapezoidal speed profile so the robot does not
+ *            overshoot.
+ *
+ * Note:      The motors are left running the last command when the
+ *            manoeuvre ends, the same as after delay().
+ ******************************************************************************/
+
+int maneuverRunning (void)
+{
+        unsigned long elapsed;
+        long moved; //distance or angle since the step started
+        int done;
+
+        if(stepIndex >= stepCount) return 0;
+
+        elapsed = millis() - stepStart;
+        done = elapsed >= stepTime[stepIndex];
+
+    //end the step early once the sensors see what it is waiting for
+        if(elapsed >= stepArm[stepIndex]){
+            if(stepUntil[stepIndex] == UNTIL_LINE
+                    && digitalRead(left) && digitalRead(right)) done = 1;
+            if(stepUntil[stepIndex] == UNTIL_CLEAR
+                    && (digitalRead(left) || digitalRead(right))) done = 1;
+        }
+
+    //distance and angle steps end on the encoders, either way
+        if(stepUntil[stepIndex] == UNTIL_DISTANCE || stepUntil[stepIndex] == UNTIL_ANGLE){
+            moved = (stepUntil[stepIndex] == UNTIL_DISTANCE ? odometryDistance() : odometryHeading()) - stepFrom;
+            if(moved < 0) moved = -moved;
+            if(moved >= stepTarget[stepIndex]) done = 1;
+        }
+
+    //slow down over the end of a long step
+        if(!done && stepTime[stepIndex] >= 2 * RAMP_DOWN
+                && stepTime[stepIndex] - elapsed < RAMP_DOWN){
+            setProfile(PROFILE_MIN + (int) ((100 - PROFILE_MIN)
+                    * (stepTime[stepIndex] - elapsed) / RAMP_DOWN));
+        }
+
+        if(done){
+            setProfile(100);
+            if(stepIndex + 1 < stepCount) startStep(stepIndex + 1);
+            else{
+                stepCount = 0; //manoeuvre finished, queue is empty
+                stepIndex = 0;
+                return 0;
+            }
+        }
+        return 1;
+} //end maneuverRunning
+
+/*******************************************************************************
+ * Function:        cancelManeuver
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Empties the queue without touching the motors. Used when the
+ *            program is stopped with the push button.
+ *
+ * Note:
+ ******************************************************************************/
+
+void cancelManeuver (void)
+{
+        setProfile(100);
+        stepCount = 0;
+        stepIndex = 0;
+} //end cancelManeuver
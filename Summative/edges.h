@@ -0,0 +1,127 @@
+//edges.h
+/*********************************************************************
+ This contains all functions that deal with catching IR sensor edges
+ on RA0 and RA1 with change notification interrupts. Other modules
+ that use change notification (the wheel encoders) run from cnHook.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define EDGE_QUEUE 16 //number of edges that can wait in the queue
+#define SENSOR_BITS 0x0003 //RA0 (left) and RA1 (right) in PORTA
+
+//	Global Variables
+/********************************************************************/
+
+volatile unsigned long edgeTime[EDGE_QUEUE]; //ticks() when each edge happened
+volatile unsigned int edgeState[EDGE_QUEUE]; //sensor bits after each edge
+volatile int edgeHead = 0; //next free place, written by the interrupt
+volatile int edgeTail = 0; //oldest edge, written by getEdge
+volatile unsigned int edgesLost = 0; //edges dropped because the queue was full
+volatile unsigned int sensorBits = 0; //sensor bits after the last edge
+void (*cnHook)(void) = 0; //optional function run from the CN interrupt
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        initEdges
+ *
+ * PreCondition:    initTimer has been called, RA0 and RA1 are digital inputs
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    change notification interrupt is enabled
+ *
+ * Overview:  Enables change notification on CN2 (RA0) and CN3 (RA1) so
+ *            every change of either IR sensor interrupts the CPU, even
+ *            while the main loop is busy or idle.
+ *
+ * Note:      The push button on RA2 (CN30) is not enabled and does not
+ *            interrupt.
+ ******************************************************************************/
+
+void initEdges (void)
+{
+        edgeHead = 0;
+        edgeTail = 0;
+        edgesLost = 0;
+        sensorBits = PORTA & SENSOR_BITS; //state before the first edge
+
+        CNEN1bits.CN2IE = 1;	// interrupt on RA0 changes
+        CNEN1bits.CN3IE = 1;	// interrupt on RA1 changes
+        IFS1bits.CNIF = 0;	// Clear out the CN flag
+        IEC1bits.CNIE = 1;	// Enable the CN interrupt
+} //end initEdges
+
+/*******************************************************************************
+ * Function:        _CNInterrupt
+ *
+ * PreCondition:    initEdges has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    an edge is added to the queue
+ *
+ * Overview:  Change notification interrupt service routine. Time-stamps the
+ *            change with the Timer2/3 count first, then reads the sensors
+ *            and queues the new state if it is different from the last one.
+ *            cnHook is then run for the other pins that interrupt.
+ *
+ * Note:      Sensor edges are only queued once initEdges has been called.
+ ******************************************************************************/
+
+void __attribute__((__interrupt__, no_auto_psv)) _CNInterrupt (void)
+{
+        unsigned long now = ticks();
+        unsigned int bits = PORTA & SENSOR_BITS; //reading PORTA ends the mismatch
+        int next = (edgeHead + 1) % EDGE_QUEUE;
+
+        if(CNEN1bits.CN2IE && bits != sensorBits){
+            if(next == edgeTail) edgesLost++; //queue full, drop the edge
+            else{
+                edgeTime[edgeHead] = now;
+                edgeState[edgeHead] = bits;
+                edgeHead = next;
+            }
+            sensorBits = bits;
+        }
+        if(cnHook) cnHook();
+
+        IFS1bits.CNIF = 0;
+} //end _CNInterrupt
+
+/*******************************************************************************
+ * Function:        getEdge
+ *
+ * PreCondition:    initEdges has been called
+ *
+ * Input:           places to put the time stamp and the sensor bits
+ *
+ * Output:          1 if an edge was taken from the queue, 0 if it was empty
+ *
+ * Side Effects:    the oldest edge is removed from the queue
+ *
+ * Overview:  Takes the oldest edge from the queue. Bit 0 of the state is
+ *            the left sensor and bit 1 is the right sensor, as read right
+ *            after the edge.
+ *
+ * Note:      Only the interrupt moves edgeHead and only getEdge moves
+ *            edgeTail, so the interrupt does not have to be masked.
+ ******************************************************************************/
+
+int getEdge (unsigned long *time, unsigned int *state)
+{
+        if(edgeTail == edgeHead) return 0;
+
+        *time = edgeTime[edgeTail];
+        *state = edgeState[edgeTail];
+        edgeTail = (edgeTail + 1) % EDGE_QUEUE;
+
+        return 1;
+} //end getEdge
@@ -0,0 +1,419 @@
+//irsensor.h
+/*********************************************************************
+ This contains all functions that read the IR line sensors. The left
+ and right sensors are on RA0 and RA1; define IR_SENSORS (3 to 8) in
+ the project's preprocessor macros to add more between them, on RA3,
+ RB4, RB13, RB14, RB0 and RB1 in that order from left to right. By
+ default they are read as digital inputs. Define ANALOG_IR in the
+ project's preprocessor macros to read them with the ADC against
+ thresholds that can be tuned, with hysteresis so a sensor on the
+ edge of the line does not chatter. The ADC scans the sensors in the
+ background, so a reading never waits on a conversion. The thresholds
+ can be measured by sweeping the robot over the line and kept in the
+ data EEPROM. Define MODULATED_IR as well to switch the IR emitters
+ from RB5 (through a transistor) and use the difference between the
+ readings with the emitters on and off, so sunlight and room lights
+ cancel out.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#ifndef IR_SENSORS
+#define IR_SENSORS 2 //number of sensors fitted, left and right only
+#endif
+
+#define IR_MAX 8 //most sensors that can be fitted
+#define IR_LOW 1400 //default reading below which a sensor is off the line
+#define IR_HIGH 2000 //default reading above which a sensor is on the line
+#define IR_MAGIC 0x4952 //saved in EE_IR_MAGIC with IR_SENSORS added once thresholds are saved
+#define IR_SPAN 300 //smallest difference between line and black that can be used
+#define SWEEP_TIME 300ul //time for each side of the calibration sweep (ms)
+
+#if IR_SENSORS < 2 || IR_SENSORS > IR_MAX
+#error "IR_SENSORS must be 2 to 8"
+#endif
+
+#if defined(MODULATED_IR) && !defined(ANALOG_IR)
+#error "MODULATED_IR needs ANALOG_IR"
+#endif
+
+//pin of each sensor
+const struct {
+        int channel; //ADC channel (ANx)
+        int portB; //1 for a PORTB pin, 0 for PORTA
+        int bit; //bit of the pin in its port
+} irPin[IR_MAX] = {
+        {0, 0, 0},	//left, RA0
+        {1, 0, 1},	//right, RA1
+        {14, 0, 3},	//RA3
+        {15, 1, 4},	//RB4
+        {11, 1, 13},	//RB13
+        {10, 1, 14},	//RB14
+        {2, 1, 0},	//RB0, also PGED1
+        {3, 1, 1},	//RB1, also PGEC1
+};
+
+//	Global Variables
+/********************************************************************/
+
+unsigned int irRaw[IR_SENSORS]; //last reading of each sensor (0 to 4095, high on the line)
+unsigned int irLow[IR_SENSORS]; //off the line threshold of each sensor
+unsigned int irHigh[IR_SENSORS]; //on the line threshold of each sensor
+int irState[IR_SENSORS]; //1 while a sensor is on the line, 0 over black
+int irSlot[IR_SENSORS]; //place of each sensor in the ADC scan
+unsigned int irMin[IR_SENSORS]; //darkest reading of each sensor in the last sweep
+unsigned int irMax[IR_SENSORS]; //brightest reading of each sensor in the last sweep
+int irLit = 0; //1 while the emitters are on (MODULATED_IR)
+int irSettled = 0; //set once a scan has been thrown away since the emitters changed
+unsigned int irLitRaw[IR_SENSORS]; //reading of each sensor with the emitters on
+volatile unsigned int irDiff[IR_SENSORS]; //emitters on minus emitters off for each sensor
+
+//functions from the main program
+int digitalRead (int pin);
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        emitterScan
+ *
+ * PreCondition:    initSensors has been called with MODULATED_IR
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the emitters on RB5 are switched, irLitRaw and irDiff are
+ *                  updated
+ *
+ * Overview:  Runs from the ADC interrupt through adcHook, after each full
+ *            scan. The first scan after the emitters change is thrown away
+ *            while the sensors settle, and the second is kept. A scan with
+ *            the emitters on is kept in irLitRaw, and the scan with them off
+ *            that follows is taken away from it to give irDiff. The emitters
+ *            are then switched for the next pair of scans.
+ *
+ * Note:      The emitters follow the ADC, so every kept scan is taken with
+ *            them fully on or fully off. A fresh irDiff comes every four
+ *            scans, about 0.9ms with two sensors at 4MHz. If something else
+ *            writes all of LATB while the emitters are switched, the scan is
+ *            thrown away and the switch is done again.
+ ******************************************************************************/
+
+void emitterScan (void)
+{
+        unsigned int value;
+        int s;
+
+        if(LATBbits.LATB5 != irLit){ //written over, start this half again
+            LATBbits.LATB5 = irLit;
+            irSettled = 0;
+            return;
+        }
+        if(!irSettled){
+            irSettled = 1;
+            return;
+        }
+
+        for(s = 0; s < IR_SENSORS; s++){
+            value = adcFrames[adcLatest].value[irSlot[s]];
+            if(irLit) irLitRaw[s] = value;
+            else irDiff[s] = irLitRaw[s] > value ? irLitRaw[s] - value : 0;
+        }
+
+        irLit = !irLit;
+        LATBbits.LATB5 = irLit;
+        irSettled = 0;
+} //end emitterScan
+
+/*******************************************************************************
+ * Function:        irSample
+ *
+ * PreCondition:    initSensors has been called with ANALOG_IR
+ *
+ * Input:           sensor (see irRead)
+ *
+ * Output:          newest reading of the sensor (0 to 4095, high on the line)
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Takes the sensor's reading from the newest ADC scan, or with
+ *            MODULATED_IR the part of it that comes from the emitters.
+ *
+ * Note:
+ ******************************************************************************/
+
+unsigned int irSample (int sensor)
+{
+#ifdef MODULATED_IR
+        return irDiff[sensor];
+#else
+        return adcValue(irSlot[sensor]);
+#endif
+} //end irSample
+
+/*******************************************************************************
+ * Function:        initSensors
+ *
+ * PreCondition:    initBattery has been called (the ADC is on), PORTA is set
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the sensor pins become inputs, with ANALOG_IR they become
+ *                  analog inputs and the ADC starts scanning them
+ *
+ * Overview:  Sets up the sensor pins for the mode the program is built for
+ *            and gives every sensor the default thresholds.
+ *
+ * Note:      Analog pins do not give change notification, so the edges of
+ *            edges.h are only caught in digital mode. Call it after PORTB is
+ *            set, or the extra sensors are left as outputs. With MODULATED_IR
+ *            the emitters start off and emitterScan takes over switching
+ *            them.
+ ******************************************************************************/
+
+void initSensors (void)
+{
+        unsigned int mask;
+        int s, c;
+
+        adcScan = 0;
+        for(s = 0; s < IR_SENSORS; s++){
+            mask = 1u << irPin[s].bit;
+            if(irPin[s].portB) TRISB |= mask;	//input
+            else TRISA |= mask;
+#ifdef ANALOG_IR
+            if(irPin[s].portB) ANSB |= mask;	//analog input
+            else ANSA |= mask;
+#else
+            if(irPin[s].portB) ANSB &= ~mask;	//digital input
+            else ANSA &= ~mask;
+#endif
+            adcScan |= 1u << irPin[s].channel;
+
+            irLow[s] = IR_LOW;
+            irHigh[s] = IR_HIGH;
+            irState[s] = 1;
+        }
+
+    //the scan gives the channels lowest first
+        for(s = 0; s < IR_SENSORS; s++){
+            irSlot[s] = 0;
+            for(c = 0; c < irPin[s].channel; c++){
+                if(adcScan & (1u << c)) irSlot[s]++;
+            }
+        }
+
+#ifdef MODULATED_IR
+        TRISBbits.TRISB5 = 0;	//emitters
+        LATBbits.LATB5 = 0;
+        irLit = 0;
+        irSettled = 0;
+        adcHook = emitterScan;
+#endif
+#ifdef ANALOG_IR
+        setAdc(1);		//scan them in the background
+#endif
+} //end initSensors
+
+/*******************************************************************************
+ * Function:        irRead
+ *
+ * PreCondition:    initSensors has been called
+ *
+ * Input:           sensor (0 for left, 1 for right, 2 on for the extra sensors
+ *                  from left to right)
+ *
+ * Output:          1 if the sensor is on the line, 0 over black
+ *
+ * Side Effects:    with ANALOG_IR, irRaw and irState are updated
+ *
+ * Overview:  Gives the same result as reading the pin as a digital input,
+ *            so the course logic works in both modes. In analog mode a
+ *            sensor only goes off the line below its low threshold and back
+ *            on above its high threshold.
+ *
+ * Note:      In analog mode the reading comes from the newest ADC scan, so
+ *            nothing is waited on. See irSample for MODULATED_IR.
+ ******************************************************************************/
+
+int irRead (int sensor)
+{
+#ifdef ANALOG_IR
+        irRaw[sensor] = irSample(sensor);
+        if(irRaw[sensor] < irLow[sensor]) irState[sensor] = 0;
+        if(irRaw[sensor] > irHigh[sensor]) irState[sensor] = 1;
+        return irState[sensor];
+#else
+        if(irPin[sensor].portB) return (PORTB >> irPin[sensor].bit) & 1;
+        return (PORTA >> irPin[sensor].bit) & 1;
+#endif
+} //end irRead
+
+/*******************************************************************************
+ * Function:        linePosition
+ *
+ * PreCondition:    initSensors has been called
+ *
+ * Input:           none
+ *
+ * Output:          -1000 to 1000, where the black line is under the array from
+ *                  the left sensor to the right sensor, negative when it is
+ *                  under the left sensors
+ *
+ * Side Effects:    every sensor is read, see irRead
+ *
+ * Overview:  Weighted centroid of the sensors, which are taken to be evenly
+ *            spaced, divided by the total weight so one sensor over black
+ *            gives its own place. In analog mode each sensor is weighted by
+ *            how far its reading is below its on the line threshold, so the
+ *            position moves smoothly as the black line comes under it; in
+ *            digital mode each sensor over black counts once.
+ *
+ * Note:      Returns 0 when no sensor sees black, which is where the robot
+ *            should be while it straddles the line. Define POSITION_STEERING
+ *            in the project's preprocessor macros to steer by it with
+ *            steerTo() while both sensors are on the line.
+ ******************************************************************************/
+
+int linePosition (void)
+{
+        long sum = 0;
+        long moment = 0;
+        long weight;
+        int place;
+        int s;
+
+        for(s = 0; s < IR_SENSORS; s++){
+#ifdef ANALOG_IR
+            irRead(s);
+            weight = (long) irHigh[s] - irRaw[s]; //darkness
+            if(weight < 0) weight = 0;
+#else
+            weight = !irRead(s);
+#endif
+            place = s == 0 ? 0 : s == 1 ? IR_SENSORS - 1 : s - 1; //left to right
+            sum += weight;
+            moment += weight * (2000l * place / (IR_SENSORS - 1) - 1000l);
+        }
+
+        if(sum == 0) return 0;
+        return (int) (moment / sum);
+} //end linePosition
+
+/*******************************************************************************
+ * Function:        loadSensors
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          1 if thresholds were read from the EEPROM, 0 if the
+ *                  defaults are used
+ *
+ * Side Effects:    irLow and irHigh are set
+ *
+ * Overview:  Call at start-up. Uses the thresholds saved by calibrateSensors
+ *            if there are any.
+ *
+ * Note:      Saved values are ignored unless each low threshold is under
+ *            its high threshold, and when they were saved for a different
+ *            number of sensors.
+ ******************************************************************************/
+
+int loadSensors (void)
+{
+        int s;
+
+        if(eeRead(EE_IR_MAGIC) != IR_MAGIC + IR_SENSORS) return 0;
+        for(s = 0; s < IR_SENSORS; s++){
+            if(eeRead(EE_IR_LOW + s) >= eeRead(EE_IR_HIGH + s)) return 0;
+        }
+
+        for(s = 0; s < IR_SENSORS; s++){
+            irLow[s] = eeRead(EE_IR_LOW + s);
+            irHigh[s] = eeRead(EE_IR_HIGH + s);
+        }
+        return 1;
+} //end loadSensors
+
+/*******************************************************************************
+ * Function:        calibrateSensors
+ *
+ * PreCondition:    initSensors has been called, the robot is on the line and
+ *                  the push button on RA2 is held
+ *
+ * Input:           1 to keep the new thresholds in the EEPROM, 0 to keep them
+ *                  for this run only
+ *
+ * Output:          1 if new thresholds were set, 0 if not
+ *
+ * Side Effects:    the robot turns on the spot and ends where it started
+ *
+ * Overview:  Waits for the button to be released, then turns right, left
+ *            and back so every sensor passes over the line and the floor
+ *            beside it, keeping the darkest and brightest reading of each.
+ *            The thresholds are put 40% and 60% of the way from dark to
+ *            bright, which gives hysteresis of a fifth of the range.
+ *
+ * Note:      Only possible with ANALOG_IR; the digital inputs have fixed
+ *            thresholds. A sensor that did not see at least IR_SPAN of
+ *            difference keeps its old thresholds.
+ ******************************************************************************/
+
+int calibrateSensors (int save)
+{
+#ifdef ANALOG_IR
+        unsigned long begin;
+        unsigned int span;
+        int changed = 0;
+        int s;
+
+    //let go of the button and move the hand away first
+        while(digitalRead(2));
+        delay(500);
+
+        for(s = 0; s < IR_SENSORS; s++){
+            irMin[s] = 0xFFFF;
+            irMax[s] = 0;
+        }
+
+    //sweep right, left past the start, then back to the start
+        begin = millis();
+        while(millis() - begin < 4 * SWEEP_TIME){
+            if(millis() - begin < SWEEP_TIME) drive(CW);
+            else if(millis() - begin < 3 * SWEEP_TIME) drive(CCW);
+            else drive(CW);
+
+            for(s = 0; s < IR_SENSORS; s++){
+                unsigned int value = irSample(s);
+                if(value < irMin[s]) irMin[s] = value;
+                if(value > irMax[s]) irMax[s] = value;
+            }
+            waitPeriod(1000ul);
+        }
+        drive(STOP);
+
+        for(s = 0; s < IR_SENSORS; s++){
+            if(irMax[s] < irMin[s] + IR_SPAN) continue; //not enough contrast
+            span = irMax[s] - irMin[s];
+            irLow[s] = irMin[s] + span / 5 * 2;
+            irHigh[s] = irMin[s] + span / 5 * 3;
+            changed = 1;
+        }
+
+        if(changed && save){
+            for(s = 0; s < IR_SENSORS; s++){
+                eeWrite(EE_IR_LOW + s, irLow[s]);
+                eeWrite(EE_IR_HIGH + s, irHigh[s]);
+            }
+            eeWrite(EE_IR_MAGIC, IR_MAGIC + IR_SENSORS);
+        }
+        return changed;
+#else
+        return 0;
+#endif
+} //end calibrateSensors
@@ -0,0 +1,129 @@
+//linespeed.h
+/*********************************************************************
+ This contains all functions that estimate ground speed and heading
+ from how long each IR sensor spends over a black line. For now the
+ results are only measured, to be read with the debugger; no turn is
+ scaled by them yet.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define TAPE_WIDTH 19 //width of the black tape (mm)
+#define SENSOR_SPACING 20 //distance between the two IR sensors (mm)
+#define MAX_SKEW 900 //largest skew reported (tenths of a degree)
+#define MAX_LINE_SPEED 3000ul //fastest ground speed believed, anything faster is noise (mm/s)
+#define MAX_OFFSET 500000l //longest time between the sensors reaching the line that is used (us)
+
+//	Global Variables
+/********************************************************************/
+
+//results of the last crossing, read with the debugger
+unsigned int lineSpeed = 0; //ground speed (mm/s), 0 until the first crossing
+int lineSkew = 0; //angle to the line (tenths of a degree), + when the left sensor is first
+unsigned long dwellUs[2]; //time each sensor spent on the line (us)
+
+unsigned int crossBits = 0x0003; //sensor bits after the last edge
+unsigned long enterAt[2]; //ticks() when each sensor reached the line
+int crossed[2]; //set once a sensor has been over the line and off it again
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        initLineSpeed
+ *
+ * PreCondition:    initEdges has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    any crossing in progress is forgotten
+ *
+ * Overview:  Starts following the sensors from the state initEdges found,
+ *            so the first edge is not taken for a crossing that never
+ *            started.
+ *
+ * Note:
+ ******************************************************************************/
+
+void initLineSpeed (void)
+{
+        crossBits = sensorBits;
+        crossed[0] = crossed[1] = 0;
+} //end initLineSpeed
+
+/*******************************************************************************
+ * Function:        lineEdge
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           time stamp and sensor bits of an edge from getEdge()
+ *
+ * Output:          1 when the edge finished a crossing, otherwise 0
+ *
+ * Side Effects:    lineSpeed and lineSkew are updated after a crossing
+ *
+ * Overview:  Follows each sensor onto and off a black line (a sensor reads
+ *            0 over black). The time a sensor spends on the line and the
+ *            tape width give the speed; the mean of both sensors is used.
+ *            The time between the two sensors reaching the line, turned
+ *            into a distance with that speed, gives the skew over the
+ *            sensor spacing.
+ *
+ * Note:      A dwell shorter than the tape takes at MAX_LINE_SPEED is
+ *            thrown away, which also keeps lineSpeed * MAX_OFFSET inside a
+ *            long. The skew uses the small angle rule (1 rad = 57.3 degrees), so
+ *            it reads low above about 20 degrees. Edges come from the CN
+ *            interrupt because the IR sensors on RA0/RA1 are not on input
+ *            capture pins; the time stamps have the same 250ns resolution.
+ ******************************************************************************/
+
+int lineEdge (unsigned long time, unsigned int bits)
+{
+        int s;
+        unsigned long mean;
+        long offset;
+        long distance;
+        long skew;
+
+        for(s = 0; s < 2; s++){
+            int was = (crossBits >> s) & 1;
+            int now = (bits >> s) & 1;
+
+        //sensor reached the line, a new crossing starts if neither was on it
+            if(was && !now){
+                if((crossBits & 0x0003) == 0x0003) crossed[0] = crossed[1] = 0;
+                enterAt[s] = time;
+            }
+
+        //sensor left the line
+            if(!was && now){
+                dwellUs[s] = (time - enterAt[s]) / TICKS_PER_US;
+                crossed[s] = 1;
+            }
+        }
+        crossBits = bits;
+
+    //wait for both sensors to be over the line and off it
+        if(!crossed[0] || !crossed[1] || (bits & 0x0003) != 0x0003) return 0;
+        crossed[0] = crossed[1] = 0;
+
+        mean = (dwellUs[0] + dwellUs[1]) / 2;
+        if(mean < TAPE_WIDTH * 1000000ul / MAX_LINE_SPEED) return 0; //too fast to be real
+        lineSpeed = (unsigned int) (TAPE_WIDTH * 1000000ul / mean);
+
+    //time between the two sensors reaching the line (us), then the distance travelled in it (um)
+        offset = (long) (enterAt[1] - enterAt[0]) / (long) TICKS_PER_US;
+        if(offset > MAX_OFFSET) offset = MAX_OFFSET;
+        if(offset < -MAX_OFFSET) offset = -MAX_OFFSET;
+        distance = (long) lineSpeed * offset / 1000;
+
+        skew = distance * 573 / (SENSOR_SPACING * 1000l);
+        if(skew > MAX_SKEW) skew = MAX_SKEW;
+        if(skew < -MAX_SKEW) skew = -MAX_SKEW;
+        lineSkew = (int) skew;
+
+        return 1;
+} //end lineEdge
@@ -3,47 +3,103 @@
  * Author: Daniel Liang
  * Date: 2017/01/10
  * Purpose: The final line following course. Refer to picture for line numbers.
- * PIC used: PIC24F32KA302 operating at 8MHz
+ * PIC used: PIC24F32KA302 operating at 8MHz (32MHz with USE_FRCPLL)
  * I/O ports used and hardware attached:
  * RB15 connected to blue LED
  * RA0 connected to pushbutton
  * RA0 connected to first IR sensor
  * RA1 connected to second IR sensor
+ * RA3, RB4, RB13, RB14, RB0, RB1 connected to extra IR sensors (IR_SENSORS)
+ * RB2 connected to left wheel encoder
+ * RB3 connected to right wheel encoder
+ * RB5 connected to the IR emitters through a transistor (MODULATED_IR)
+ * RB12 connected to the motor battery through a 10k/10k divider
  * L293:
- * pin 2 to RB15
- * pin 7 to RB14
- * pin 10 to RB13
- * pin 13 to RB12
+ * pin 1 to OC1 (left wheel PWM)
+ * pin 9 to OC2 (right wheel PWM)
+ * pin 2 to RB9 (1A, left wheel)
+ * pin 7 to RB8 (2A, left wheel)
+ * pin 10 to RB6 (3A, right wheel)
+ * pin 15 to RB7 (4A, right wheel)
 */
 
 //Include Files
 #include "p24F32KA302.h"
 #include "configBits.h"
+#include "power.h"
 #include "delay.h"
+#include "motor.h"
+#include "eeprom.h"
+#include "adc.h"
+#include "battery.h"
+#include "irsensor.h"
+#include "trim.h"
+#include "latency.h"
+#include "edges.h"
+#include "odometry.h"
+#include "encoders.h"
+#include "lineevent.h"
+#include "linespeed.h"
+#include "maneuver.h"
+#include "scheduler.h"
 
 //constants for pins
-const int LF = 9; //Left red 1A
-const int LR = 8; //left green 2A
-const int RF = 6; //Right red 3A
-const int RR = 7; //Right green 4A
 const int left = 0; //left sensor
 const int right = 1; //right sensor
 const int indicator = 15; //indicator of robot
 
-//constants for direction of robot
-const int FWD = 0; //go forward
-const int LEFT = 1; //turn left
-const int RIGHT = 2; //turn right
-const int CW = 3; //turn clockwise
-const int CCW = 4; //turn counterclockwise
-const int BWD = 5; //reverse
-const int STOP = 6; //stop the motors
-const int RLEFT = 7; //reverse left
-const int RRIGHT = 8; //reverse right
-
 //Local Function Prototypes
+void idleFor (unsigned long micro);
 void initTimer (void);
 void delay (unsigned long milli);
+unsigned long millis (void);
+unsigned long micros (void);
+void initMotors (void);
+void setDuty (int leftSpeed, int rightSpeed);
+void initBattery (void);
+void measureBattery (void);
+void checkBattery (void);
+unsigned long batteryTime (unsigned long milli);
+void initSensors (void);
+int irRead (int sensor);
+int loadSensors (void);
+int calibrateSensors (int save);
+void steer (int direction);
+void steerTo (int position);
+int linePosition (void);
+int loadTrim (int leftDefault, int rightDefault);
+void waitForButton (int led);
+int calibrateTrim (unsigned long milli);
+void digitalWrite (int pin, int power);
+void initEdges (void);
+int getEdge (unsigned long *time, unsigned int *state);
+void initLineSpeed (void);
+int lineEdge (unsigned long time, unsigned int bits);
+void initOdometry (void);
+void queueManeuver (int direction, unsigned long milli, unsigned long arm, int until);
+int maneuverRunning (void);
+int lineEvent (int leftOn, int rightOn);
+void resetLineEvent (void);
+void cancelManeuver (void);
+int addTask (void (*function)(void), unsigned long period);
+void runTasks (void);
+unsigned int overrunCount (void);
+void sensorTask (void);
+void controlTask (void);
+void buttonTask (void);
+
+//task periods in microseconds
+#define SENSOR_PERIOD 500ul //sample sensors at 2kHz
+#define CONTROL_PERIOD 1000ul //steer the robot at 1kHz
+#define BUTTON_PERIOD 20000ul //read the switch and set the LED at 50Hz
+
+//variables shared by the tasks
+int leftSeen = 0; //filtered left sensor reading
+int rightSeen = 0; //filtered right sensor reading
+int pressed = 0; //used for positive edge
+int unpressed = 0; //used for negative edge toggle on/off the motors
+int start = 0; //start line indicator
+int bcount = 0; //black line counter
 
 //main function
 int main ()
@@ -52,202 +108,206 @@ int main ()
     initTimer(); //initialize peripherals
     TRISB=0; //PORTB all outputs
     LATB=0; // initialize PORTB
+    initMotors(); //L293 inputs low, PWM on the enable pins
+    loadTrim(95, 100); //saved wheel trim, or these if none is saved
+    initBattery(); //ADC on, first battery reading
     TRISA=0xFF; //PORTA all [digital] inputs
     ANSA=0; //all digital inputs
+    initSensors(); //IR sensors analog with ANALOG_IR
+    loadSensors(); //saved IR thresholds, if there are any
+    //button held at reset, calibrate on a straight line
+    if(digitalRead(2)){
+        calibrateSensors(1); //IR thresholds, kept in the EEPROM
+        waitForButton(indicator); //LED flashes: square the robot on the line, then press
+        calibrateTrim(CALIBRATE_TIME); //wheel trim
+    }
+    initEdges(); //time stamp sensor changes from now on
+    initLineSpeed(); //time line crossings from the edges
+    initOdometry(); //count wheel encoder edges on RB2 and RB3
 
-    //local variables
-    int pressed = 0; //used for positive edge
-    int unpressed = 0; //used for negative edge toggle on/off the motors
-    int start = 0; //start line indicator
-    int bcount = 0; //black line counter
-    int fcount = 0; //milliseconds moving forward counter for trimming
-
-    while(1){//repeat forever and read inputs
-        //if the switch was pressed and motors are off
-        if(digitalRead(2) && !pressed && !unpressed){
-            pressed = 1; //positive edge (wait)
-        }
-
-        //when the switch is released, negative edge trigger
-        if(!digitalRead(2) && pressed){
-            unpressed = 1; //motors are running
-            digitalWrite(indicator, 1); //indicating motors are ready
-
-            //move from start line
-            if(start == 0){
-                while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2)){
-                    drive(FWD);
-                }
-                start = 1; //start line cleared
-            }
-
-            //If robot on line, move forward
-            if(digitalRead(left) && digitalRead(right)){
-                fcount++; //counter for number of milliseconds
-                //slow down left motor to 95% speed (trimming)
-                if((fcount % 20) == 0) drive(LEFT);
-                else drive(FWD);
-                delay(1);
-            }
-
-            //if robot sees horizontal black line
-            else if(!digitalRead(left) && !digitalRead(right)){ 
-                bcount++; //increment black line counter
-
-                //drive straight through these lines
-                if(bcount == 1 || bcount == 2 || bcount == 3 || bcount == 5 ||
-                         bcount == 6 || bcount == 7 || bcount == 9 || bcount == 12 ||
-                         bcount == 14 || bcount == 15 || bcount == 18 || bcount == 21 ||
-                         bcount == 22 || bcount == 24){
-                    drive(FWD); delay(1); //wake up the PIC, ensures next line is executed
-                    drive(FWD); //forward until past the black line
-                    while((!digitalRead(left) || !digitalRead(right)) && !digitalRead(2));
-                    delay(10); //prevent doble counting
-                }
-
-                //drive straight through this line and correct direction
-                if(bcount == 23){
-                    drive(FWD); delay(1); //wake up the PIC, ensures next line is executed
-                    drive(FWD); //forward until past the black line
-                    while((!digitalRead(left) || !digitalRead(right)) && !digitalRead(2));
-                    drive(FWD); delay(1);
-                    drive(CCW);//straighten robot
-                    delay(200);
-                }
-
-                //smooth long left turn at these lines
-                if(bcount == 4 || bcount == 13){
-                    drive(CCW); delay(1);
-                    drive(LEFT);
-                    delay(800);
-                }
-
-                //smooth short left turn at these lines
-                if(bcount == 8 || bcount == 20){
-                    drive(CCW); delay(1);
-                    drive(LEFT);
-                    delay(500);
-                }
-
-                //smooth right turn at these lines
-                if(bcount == 10 || bcount == 11){
-                    drive(CW); delay(1);
-                    drive(RIGHT);
-                    delay(500);
-                }
-
-                //ignore these lines
-                if(bcount == 16 || bcount == 17){
-                    drive(CW); delay(1);
-                    drive(CW); //straighten robot
-                    while(!digitalRead(left) && !digitalRead(right) && !digitalRead(2));
-                    drive(FWD); //drive bast the T intersection
-                    while((!digitalRead(left) || !digitalRead(right)) && !digitalRead(2));
-                }
-
-                //stop once at this line
-                if(bcount == 19){
-                    drive(STOP); delay(1);
-                    drive(BWD); //brake
-                    delay(50);
-                    drive(STOP); //stop for 500 ms
-                    delay(500);
-                    drive(FWD); //move past the black line
-                    while((!digitalRead(left) || !digitalRead(right)) && !digitalRead(2));
-                }
-
-                //terminate program at this line
-                if(bcount == 25){
-                    pressed = 0;
-                }
-
-            }//end black line if
-
-            //If robot right of line, turn left
-            else if(!digitalRead(left) && digitalRead(right)){
-                drive(CCW);
-            }
-
-            //If robot left of line, turn right
-            else if(digitalRead(left) && !digitalRead(right)){
-                drive(CW);
-            }
-        }//end if (motor sequences)
-
-        //if the switch is pressed and motors are on
-        if(digitalRead(2) && unpressed){
-            pressed = 0; //positive edge (wait)
-        }
+    //fastest task first
+    addTask(sensorTask, SENSOR_PERIOD);
+    addTask(controlTask, CONTROL_PERIOD);
+    addTask(buttonTask, BUTTON_PERIOD);
 
-        //when the switch is released, negative edge trigger or program is finished
-        if(!digitalRead(2) && !pressed){
-            drive(STOP);
-            unpressed = 0; //motors are off
-            fcount = 0; //reset forward trim counter
-            bcount = 0; //reset black line counter
-            start = 0; //reset start line indicator
-            digitalWrite(indicator, 0); //incating motors are off
-        }
+    while(1){//repeat forever and run the tasks that are due
+        runTasks();
     }//end while
 }//end main
 
-//drives the robot in a direction
-void drive(int direction){
-    if(direction == FWD){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
+//samples the IR sensors, a reading is only accepted once it repeats
+void sensorTask(void){
+    static int lastLeft = 0; //previous left sample
+    static int lastRight = 0; //previous right sample
+    int leftNow = digitalRead(left);
+    int rightNow = digitalRead(right);
+    unsigned long time; //time stamp of a queued edge
+    unsigned int state; //sensor bits after a queued edge
+
+    //time each line crossing from the edges caught by the CN interrupt
+    while(getEdge(&time, &state)){
+        lineEdge(time, state); //updates lineSpeed and lineSkew
     }
-    else if(direction == LEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
+
+    if(leftNow == lastLeft) leftSeen = leftNow;
+    if(rightNow == lastRight) rightSeen = rightNow;
+    lastLeft = leftNow;
+    lastRight = rightNow;
+}//end sensorTask
+
+//follows the line and counts black lines, never waits on the sensors
+void controlTask(void){
+    int running; //a manoeuvre is in progress
+    int event; //black line event from the sensors
+
+    LATENCY_START(); //time stamp this pass, the idle time between tasks is not counted
+
+    //only steer while the motors are on
+    if(!pressed || !unpressed){
+        LATENCY_END();
+        return;
+    }
+
+    //move from start line
+    if(start == 0){
+        queueManeuver(FWD, STEP_TIMEOUT, 0, UNTIL_CLEAR);
+        start = 1; //start line cleared
     }
-    else if(direction == RIGHT){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
+
+    //black lines are only looked for between manoeuvres
+    running = maneuverRunning();
+    if(running) resetLineEvent(); //start again from the sensors once it ends
+    event = running ? LINE_NONE : lineEvent(leftSeen, rightSeen);
+
+    //keep going until the manoeuvre in progress is finished
+    if(running){
+        //the manoeuvre watches the sensors itself
+        LATENCY_BRANCH(BRANCH_MANEUVER);
     }
-    else if(direction == CW){
-        digitalWrite(LF, 1);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
+
+    //If robot on line, move forward
+    else if(leftSeen && rightSeen){
+        LATENCY_BRANCH(BRANCH_ON_LINE);
+#ifdef POSITION_STEERING
+        steerTo(linePosition()); //correct before either sensor leaves the line
+#else
+        drive(FWD); //wheels trimmed by loadTrim
+#endif
+    }
+
+    //if robot reaches a horizontal black line, once per line
+    else if(event == LINE_ENTER){
+        LATENCY_BRANCH(BRANCH_BLACK);
+        bcount++; //increment black line counter
+
+        //drive straight through these lines
+        if(bcount == 1 || bcount == 2 || bcount == 3 || bcount == 5 ||
+                 bcount == 6 || bcount == 7 || bcount == 9 || bcount == 12 ||
+                 bcount == 14 || bcount == 15 || bcount == 18 || bcount == 21 ||
+                 bcount == 22 || bcount == 24){
+            queueManeuver(FWD, 1, 0, UNTIL_TIME); //wake up the PIC
+            queueManeuver(FWD, STEP_TIMEOUT, 0, UNTIL_LINE); //forward until past the black line
+        }
+
+        //drive straight through this line and correct direction
+        if(bcount == 23){
+            queueManeuver(FWD, 1, 0, UNTIL_TIME); //wake up the PIC
+            queueManeuver(FWD, STEP_TIMEOUT, 0, UNTIL_LINE); //forward until past the black line
+            queueManeuver(FWD, 1, 0, UNTIL_TIME);
+            queueManeuver(CCW, 200, 0, UNTIL_TIME); //straighten robot
+        }
+
+        //smooth long left turn at these lines
+        if(bcount == 4 || bcount == 13){
+            queueManeuver(CCW, 1, 0, UNTIL_TIME);
+            //turn until the line is found again, 800 ms at most
+            queueManeuver(LEFT, 800, 400, UNTIL_LINE);
+        }
+
+        //smooth short left turn at these lines
+        if(bcount == 8 || bcount == 20){
+            queueManeuver(CCW, 1, 0, UNTIL_TIME);
+            queueManeuver(LEFT, 500, 250, UNTIL_LINE);
+        }
+
+        //smooth right turn at these lines
+        if(bcount == 10 || bcount == 11){
+            queueManeuver(CW, 1, 0, UNTIL_TIME);
+            queueManeuver(RIGHT, 500, 250, UNTIL_LINE);
+        }
+
+        //ignore these lines
+        if(bcount == 16 || bcount == 17){
+            queueManeuver(CW, 1, 0, UNTIL_TIME);
+            queueManeuver(CW, STEP_TIMEOUT, 0, UNTIL_CLEAR); //straighten robot
+            queueManeuver(FWD, STEP_TIMEOUT, 0, UNTIL_LINE); //drive bast the T intersection
+        }
+
+        //stop once at this line
+        if(bcount == 19){
+            queueManeuver(BRAKE, 100, 0, UNTIL_TIME); //short the motors to stop quickly
+            queueManeuver(STOP, 450, 0, UNTIL_TIME); //stand still for the rest of 550 ms
+            queueManeuver(FWD, STEP_TIMEOUT, 0, UNTIL_LINE); //move past the black line
+        }
+
+        //terminate program at this line
+        if(bcount == 25){
+            drive(STOP); //the button task resets the counters
+            pressed = 0;
+        }
+
+    }//end black line if
+
+    //If robot right of line, turn left
+    else if(!leftSeen && rightSeen){
+        LATENCY_BRANCH(BRANCH_TURN_LEFT);
+        steer(CCW); //slow the inside wheel more the longer the line is lost
     }
-    else if(direction == CCW){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 1);
-        digitalWrite(RR, 0);
+
+    //If robot left of line, turn right
+    else if(leftSeen && !rightSeen){
+        LATENCY_BRANCH(BRANCH_TURN_RIGHT);
+        steer(CW); //slow the inside wheel more the longer the line is lost
     }
-    else if(direction == BWD){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
+
+    LATENCY_END(); //motors set for this pass
+}//end controlTask
+
+//reads the switch and sets the indicator LED
+void buttonTask(void){
+    int button = digitalRead(2);
+
+    checkBattery(); //read the battery again every second
+
+    //if the switch was pressed and motors are off
+    if(button && !pressed && !unpressed){
+        pressed = 1; //positive edge (wait)
+        measureBattery(); //scale the run for the battery as it is now
     }
-    else if(direction == STOP){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
+
+    //when the switch is released, negative edge trigger
+    if(!button && pressed){
+        unpressed = 1; //motors are running
+        digitalWrite(indicator, 1); //indicating motors are ready
     }
-    else if(direction == RLEFT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 0);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 1);
+
+    //if the switch is pressed and motors are on
+    if(button && unpressed){
+        pressed = 0; //positive edge (wait)
     }
-    else if(direction == RRIGHT){
-        digitalWrite(LF, 0);
-        digitalWrite(LR, 1);
-        digitalWrite(RF, 0);
-        digitalWrite(RR, 0);
+
+    //when the switch is released, negative edge trigger or program is finished
+    if(!button && !pressed){
+        drive(STOP);
+        cancelManeuver(); //drop any unfinished turn
+        resetLineEvent(); //forget any line in progress
+        unpressed = 0; //motors are off
+        bcount = 0; //reset black line counter
+        start = 0; //reset start line indicator
+        //incating motors are off, flash if a task has overrun
+        digitalWrite(indicator, overrunCount() && (millis() / 250) % 2);
     }
-}//end drive
+}//end buttonTask
 
 //This function assigns a state to pins RB6 to RB15
 void digitalWrite(int pin, int power){
@@ -289,10 +349,10 @@ void digitalWrite(int pin, int power){
 int digitalRead(int pin){
     switch(pin){
         case 0:
-            return PORTAbits.RA0;
+            return irRead(0); //digital or analog, see irsensor.h
         break;
         case 1:
-            return PORTAbits.RA1;
+            return irRead(1); //digital or analog, see irsensor.h
         break;
         case 2:
             return PORTAbits.RA2;
@@ -0,0 +1,615 @@
+//motor.h
+/*********************************************************************
+ This contains all functions that drive the two motors through the
+ L293. The direction of each wheel is set on RB6 to RB9 and the speed
+ of each wheel is set by PWM from the Output Compare modules on the
+ L293 enable pins (pin 1 to OC1 for the left wheel, pin 9 to OC2 for
+ the right wheel, instead of being tied to 5V). Speed changes are
+ ramped from the 1ms tick so the wheels do not slip. A wheel that
+ reverses is held off for a dead time first. Line corrections
+ slow the inside wheel instead of pivoting; define PIVOT_STEERING in
+ the project's preprocessor macros to pivot with CW and CCW instead.
+ steerTo() slows the inside wheel by a line position instead of time.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define PWM_FREQ 20000ul //PWM frequency on the enable pins (Hz)
+#define PWM_PERIOD ((unsigned int) (FCY / PWM_FREQ)) //Fcyc clock cycles in one PWM period
+#define RAMP_RATE 20 //default speed change per ms (tenths of a percent)
+#define DEAD_TIME 5 //default time a reversing wheel is held off (ms)
+#define STEER_START 20 //steering as soon as a sensor leaves the line (%)
+#define STEER_GAIN 1 //steering added for each ms the line stays lost (%)
+#define STEER_FLOOR 0 //slowest the inside wheel goes while steering, still forward (%)
+#define POSITION_GAIN 100 //steering for a line position of 1000 in steerTo (%)
+
+//PORTB pins of the L293 inputs, the only place to change if the motors are rewired
+#define LF 9 //Left red 1A
+#define LR 8 //left green 2A
+#define RF 6 //Right red 3A
+#define RR 7 //Right green 4A
+
+#define MOTOR_MASK ((1u << LF) | (1u << LR) | (1u << RF) | (1u << RR))
+
+//L293 inputs for a direction of each wheel (1 forward, 0 off, -1 reverse)
+#define INPUTS(l, r) (((l) > 0 ? 1u << LF : 0) | ((l) < 0 ? 1u << LR : 0) \
+                    | ((r) > 0 ? 1u << RF : 0) | ((r) < 0 ? 1u << RR : 0))
+
+//direction of robot
+enum direction {
+        FWD, //go forward
+        LEFT, //turn left
+        RIGHT, //turn right
+        CW, //turn clockwise
+        CCW, //turn counterclockwise
+        BWD, //reverse
+        STOP, //stop the motors
+        RLEFT, //reverse left
+        RRIGHT, //reverse right
+        BRAKE, //short both motors through the L293 to stop quickly
+        DIRECTIONS //number of directions
+};
+
+//	Global Variables
+/********************************************************************/
+
+//motor command for each direction, in the order of enum direction
+const struct {
+        unsigned int inputs; //L293 inputs that are high
+        signed char left; //left wheel direction
+        signed char right; //right wheel direction
+} command[DIRECTIONS] = {
+        {INPUTS(1, 1), 1, 1}, //FWD
+        {INPUTS(0, 1), 0, 1}, //LEFT
+        {INPUTS(1, 0), 1, 0}, //RIGHT
+        {INPUTS(1, -1), 1, -1}, //CW
+        {INPUTS(-1, 1), -1, 1}, //CCW
+        {INPUTS(-1, -1), -1, -1}, //BWD
+        {INPUTS(0, 0), 0, 0}, //STOP
+        {INPUTS(0, -1), 0, -1}, //RLEFT
+        {INPUTS(-1, 0), -1, 0}, //RRIGHT
+        {MOTOR_MASK, 0, 0}, //BRAKE, both inputs of each wheel high
+};
+
+int leftDuty = 100; //left wheel target speed (%)
+int rightDuty = 100; //right wheel target speed (%)
+volatile int leftNow = 0; //left wheel speed being output (tenths of a percent)
+volatile int rightNow = 0; //right wheel speed being output (tenths of a percent)
+int rampRate = RAMP_RATE; //speed change per ms (tenths of a percent), 0 for none
+volatile int profile = 100; //scale on both targets, lowered at the end of a turn (%)
+volatile int supplyScale = 1000; //scale on both targets for the battery voltage (per mille)
+int leftDir = 0; //left wheel direction: 1 forward, 0 off, -1 reverse
+int rightDir = 0; //right wheel direction: 1 forward, 0 off, -1 reverse
+volatile int leftDriven = 0; //left wheel direction on the L293 inputs now, 0 while off
+volatile int rightDriven = 0; //right wheel direction on the L293 inputs now, 0 while off
+int leftLast = 0; //last direction the left wheel was driven, kept while it coasts
+int rightLast = 0; //last direction the right wheel was driven, kept while it coasts
+unsigned long leftOffAt = 0; //msTicks when the left wheel was last driven
+unsigned long rightOffAt = 0; //msTicks when the right wheel was last driven
+volatile int leftSteer = 100; //scale on the left target while steering (%)
+volatile int rightSteer = 100; //scale on the right target while steering (%)
+int steerDirection = STOP; //correction in progress (CW or CCW), STOP for none
+unsigned long steerStart = 0; //millis() when the correction started
+int deadTime = DEAD_TIME; //time a reversing wheel is held off (ms), 0 for none
+volatile int deadCount = 0; //ms left before pendingDirection is applied
+volatile int pendingDirection = STOP; //direction to apply after the dead time
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        writeDuty
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the new speed takes effect at the start of the next PWM
+ *                  period
+ *
+ * Overview:  Loads the speeds being output into the OC1 and OC2 duty
+ *            registers.
+ *
+ * Note:
+ ******************************************************************************/
+
+void writeDuty (void)
+{
+        OC1R = (unsigned int) ((unsigned long) PWM_PERIOD * leftNow / 1000);
+        OC2R = (unsigned int) ((unsigned long) PWM_PERIOD * rightNow / 1000);
+} //end writeDuty
+
+/*******************************************************************************
+ * Function:        rampToward
+ *
+ * PreCondition:    -
+ *
+ * Input:           speed being output and target speed (tenths of a percent)
+ *
+ * Output:          speed to output for the next millisecond
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Moves a speed one ramp step toward its target.
+ *
+ * Note:      With rampRate 0 the target is returned right away.
+ ******************************************************************************/
+
+int rampToward (int now, int target)
+{
+        if(rampRate == 0) return target;
+        if(now < target){
+            now += rampRate;
+            if(now > target) now = target;
+        }
+        else if(now > target){
+            now -= rampRate;
+            if(now < target) now = target;
+        }
+        return now;
+} //end rampToward
+
+/*******************************************************************************
+ * Function:        holdTime
+ *
+ * PreCondition:    the Timer1 interrupt is held off
+ *
+ * Input:           direction wanted for a wheel, and the wheel's driven
+ *                  direction, last driven direction and the time it was
+ *                  last driven
+ *
+ * Output:          time the wheel must stay off before it is driven the
+ *                  new way (ms), 0 to drive it now
+ *
+ * Side Effects:    none
+ *
+ * Overview:  A wheel going the opposite way to the last way it was driven
+ *            must be off for deadTime ms first. A wheel still driven needs
+ *            all of it; one that is already off (stopped, braked or held)
+ *            only needs what is left since it was last driven.
+ *
+ * Note:
+ ******************************************************************************/
+
+int holdTime (int want, int driven, int last, unsigned long offAt)
+{
+        unsigned long off;
+
+        if(!deadTime || want * last >= 0) return 0; //not a reversal
+        if(driven) return deadTime;
+
+        off = msTicks - offAt;
+        if(off >= (unsigned long) deadTime) return 0; //has had time to stop
+        return deadTime - (int) off;
+} //end holdTime
+
+/*******************************************************************************
+ * Function:        setDriven
+ *
+ * PreCondition:    the Timer1 interrupt is held off, or called from it
+ *
+ * Input:           the wheel's driven direction, last driven direction and
+ *                  time it was last driven, and its new driven direction
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Keeps track of a wheel after its L293 inputs change, for
+ *            holdTime. A wheel that goes off keeps its last direction and
+ *            the time it went off.
+ *
+ * Note:
+ ******************************************************************************/
+
+void setDriven (volatile int *driven, int *last, unsigned long *offAt, int now)
+{
+        if(*driven && !now) *offAt = msTicks;
+        if(now) *last = now;
+        *driven = now;
+} //end setDriven
+
+/*******************************************************************************
+ * Function:        rampMotors
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    the PWM duty of both wheels changes
+ *
+ * Overview:  Runs from the 1ms Timer1 tick. Moves each wheel's speed one
+ *            step toward its target, scaled by profile, so the wheels speed
+ *            up and slow down at rampRate instead of jumping. leftSteer
+ *            and rightSteer slow the inside wheel while steering, and
+ *            supplyScale makes up for the battery voltage.
+ *
+ * Note:      While a dead time is running the speeds are held; when it
+ *            ends the new L293 inputs are applied. When the faster wheel
+ *            would need more than full speed, both targets are cut by the
+ *            same factor so the trim between the wheels is kept.
+ ******************************************************************************/
+
+void rampMotors (void)
+{
+        long leftGoal;
+        long rightGoal;
+        long largest;
+
+    //hold the reversing wheel off until the dead time is over
+        if(deadCount){
+            if(--deadCount) return;
+            LATB = (LATB & ~MOTOR_MASK) | command[pendingDirection].inputs;
+            setDriven(&leftDriven, &leftLast, &leftOffAt, command[pendingDirection].left);
+            setDriven(&rightDriven, &rightLast, &rightOffAt, command[pendingDirection].right);
+        }
+
+        leftGoal = (long) leftDuty * profile * leftSteer / 1000 * supplyScale / 1000;
+        rightGoal = (long) rightDuty * profile * rightSteer / 1000 * supplyScale / 1000;
+
+    //past full speed, slow both wheels together to keep their ratio
+        largest = leftGoal > rightGoal ? leftGoal : rightGoal;
+        if(largest > 1000){
+            leftGoal = leftGoal * 1000 / largest;
+            rightGoal = rightGoal * 1000 / largest;
+        }
+        leftNow = rampToward(leftNow, (int) leftGoal);
+        rightNow = rampToward(rightNow, (int) rightGoal);
+        writeDuty();
+} //end rampMotors
+
+/*******************************************************************************
+ * Function:        setDuty
+ *
+ * PreCondition:    -
+ *
+ * Input:           left and right wheel speed in percent (0 to 100)
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Sets the target speed of each wheel. The speed being output
+ *            ramps to it from the 1ms tick. The direction set by drive()
+ *            is kept, so trimming or slowing a wheel does not cost any
+ *            CPU time once it is set.
+ *
+ * Note:      Values outside 0 to 100 are clamped.
+ ******************************************************************************/
+
+void setDuty (int leftSpeed, int rightSpeed)
+{
+        if(leftSpeed < 0) leftSpeed = 0;
+        if(leftSpeed > 100) leftSpeed = 100;
+        if(rightSpeed < 0) rightSpeed = 0;
+        if(rightSpeed > 100) rightSpeed = 100;
+
+        leftDuty = leftSpeed;
+        rightDuty = rightSpeed;
+} //end setDuty
+
+/*******************************************************************************
+ * Function:        setRamp
+ *
+ * PreCondition:    -
+ *
+ * Input:           speed change per millisecond in tenths of a percent
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Sets how fast the wheels speed up and slow down. 20 takes a
+ *            wheel from stopped to full speed in 50ms. 0 turns ramping off.
+ *
+ * Note:
+ ******************************************************************************/
+
+void setRamp (int rate)
+{
+        if(rate < 0) rate = 0;
+        rampRate = rate;
+} //end setRamp
+
+/*******************************************************************************
+ * Function:        setDeadTime
+ *
+ * PreCondition:    -
+ *
+ * Input:           time in milliseconds
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Sets how long a wheel that changes between forward and reverse
+ *            is held off first, so the L293 and the battery do not take
+ *            the full reversing current spike. 0 turns the dead time off.
+ *
+ * Note:
+ ******************************************************************************/
+
+void setDeadTime (int milli)
+{
+        if(milli < 0) milli = 0;
+        deadTime = milli;
+} //end setDeadTime
+
+/*******************************************************************************
+ * Function:        setProfile
+ *
+ * PreCondition:    -
+ *
+ * Input:           scale on both wheel targets in percent (0 to 100)
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Used by the manoeuvres to slow the wheels down over the end
+ *            of a timed turn, which gives each turn a trapezoidal speed
+ *            profile. Set back to 100 for normal driving.
+ *
+ * Note:
+ ******************************************************************************/
+
+void setProfile (int percent)
+{
+        if(percent < 0) percent = 0;
+        if(percent > 100) percent = 100;
+        profile = percent;
+} //end setProfile
+
+/*******************************************************************************
+ * Function:        setDirection
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           direction of the robot (FWD, LEFT, RIGHT, CW, CCW, BWD,
+ *                  STOP, RLEFT, RRIGHT or BRAKE)
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Sets the L293 inputs for each wheel. A wheel that changes
+ *            direction or starts from off ramps up from stopped. A wheel
+ *            that goes straight from forward to reverse, or back, is turned
+ *            off first and only gets its new inputs from rampMotors once
+ *            deadTime ms have passed. BRAKE is applied right away with the
+ *            enable pins full on. Used by drive() and steer(), which may call
+ *            it on every pass: asking again for the direction already
+ *            waiting on a dead time leaves the dead time running.
+ *
+ * Note:      All four inputs change in one write to LATB, so the L293 never
+ *            sees a mix of the old and new direction (such as both inputs
+ *            of a wheel high while going from CW to CCW). The other PORTB
+ *            pins are left as they were. The direction indexes the command
+ *            table, so every direction takes the same time. Anything out of
+ *            range stops the motors. The Timer1 interrupt is held off while
+ *            LATB is written so rampMotors cannot write it at the same time.
+ *            Reversing is judged against the last way each wheel was
+ *            really driven and how long it has been off since (holdTime),
+ *            so going from reverse to STOP to forward inside deadTime is
+ *            held off too.
+ ******************************************************************************/
+
+void setDirection (int direction)
+{
+        unsigned int inputs;
+        int leftHold;
+        int rightHold;
+
+        if(direction < 0 || direction >= DIRECTIONS) direction = STOP;
+        inputs = command[direction].inputs;
+
+        IEC0bits.T1IE = 0;	//keep rampMotors out while LATB changes
+
+    //already waiting out the dead time for this direction
+        if(deadCount && direction == pendingDirection){
+            IEC0bits.T1IE = 1;
+            return;
+        }
+
+    //turn a reversing wheel off first, the rest change right away
+        leftHold = holdTime(command[direction].left, leftDriven, leftLast, leftOffAt);
+        rightHold = holdTime(command[direction].right, rightDriven, rightLast, rightOffAt);
+        if(leftHold) inputs &= ~((1u << LF) | (1u << LR));
+        if(rightHold) inputs &= ~((1u << RF) | (1u << RR));
+
+        deadCount = leftHold > rightHold ? leftHold : rightHold;
+        pendingDirection = direction;
+        LATB = (LATB & ~MOTOR_MASK) | inputs;
+        setDriven(&leftDriven, &leftLast, &leftOffAt, leftHold ? 0 : command[direction].left);
+        setDriven(&rightDriven, &rightLast, &rightOffAt, rightHold ? 0 : command[direction].right);
+
+    //a wheel that changes direction starts again from stopped
+        if(command[direction].left != leftDir && rampRate) leftNow = 0;
+        if(command[direction].right != rightDir && rampRate) rightNow = 0;
+        leftDir = command[direction].left;
+        rightDir = command[direction].right;
+
+    //brake as hard as the L293 can
+        if(direction == BRAKE){
+            leftNow = 1000;
+            rightNow = 1000;
+            writeDuty();
+        }
+        IEC0bits.T1IE = 1;
+} //end setDirection
+
+/*******************************************************************************
+ * Function:        drive
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           direction of the robot (FWD, LEFT, RIGHT, CW, CCW, BWD,
+ *                  STOP, RLEFT, RRIGHT or BRAKE)
+ *
+ * Output:          none
+ *
+ * Side Effects:    any steering correction is ended
+ *
+ * Overview:  Drives the robot in the given direction with both wheels at
+ *            the speeds last set with setDuty.
+ *
+ * Note:
+ ******************************************************************************/
+
+void drive (int direction)
+{
+        leftSteer = 100;
+        rightSteer = 100;
+        steerDirection = STOP;
+        setDirection(direction);
+} //end drive
+
+/*******************************************************************************
+ * Function:        steer
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           CW to turn right or CCW to turn left
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Used in place of drive(CW) or drive(CCW) when a sensor has
+ *            left the line. Both wheels keep going forward and the inside
+ *            wheel is slowed by STEER_START, plus STEER_GAIN for every
+ *            millisecond since the correction started, down to STEER_FLOOR.
+ *            The inside wheel never turns backward, so the direction stays
+ *            FWD and no dead time starts in the middle of a curve. Call it
+ *            on every pass while the line is lost; drive() ends the
+ *            correction.
+ *
+ * Note:      With PIVOT_STEERING defined this is the same as drive(), which
+ *            pivots on the spot for corners too sharp to curve round.
+ ******************************************************************************/
+
+void steer (int direction)
+{
+#ifdef PIVOT_STEERING
+        drive(direction);
+#else
+        unsigned long amount;
+        int inside;
+
+        if(direction != CW && direction != CCW){
+            drive(direction);
+            return;
+        }
+
+    //a new correction, or one the other way, starts small
+        if(steerDirection != direction){
+            steerDirection = direction;
+            steerStart = millis();
+        }
+        amount = STEER_START + STEER_GAIN * (millis() - steerStart);
+        if(amount > 100 - STEER_FLOOR) amount = 100 - STEER_FLOOR;
+
+    //slow the inside wheel, both wheels keep going forward
+        inside = 100 - (int) amount;
+        setDirection(FWD);
+
+        if(direction == CW){
+            leftSteer = 100;
+            rightSteer = inside;
+        }
+        else{
+            leftSteer = inside;
+            rightSteer = 100;
+        }
+#endif
+} //end steer
+
+/*******************************************************************************
+ * Function:        steerTo
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           line position from linePosition() (-1000 to 1000)
+ *
+ * Output:          none
+ *
+ * Side Effects:    any timed correction from steer() is ended
+ *
+ * Overview:  Drives forward and slows the inside wheel in proportion to the
+ *            line position, by POSITION_GAIN at 1000 and down to
+ *            STEER_FLOOR. A negative position (the black line under the
+ *            left sensors) turns left like steer(CCW), the way the robot
+ *            turns when only the left sensor reads black.
+ *            Call it on every pass while the sensors see the line, so the
+ *            robot corrects before a sensor leaves it.
+ *
+ * Note:      0 is the same as drive(FWD).
+ ******************************************************************************/
+
+void steerTo (int position)
+{
+        long amount = (long) (position < 0 ? -position : position) * POSITION_GAIN / 1000;
+
+        if(amount > 100 - STEER_FLOOR) amount = 100 - STEER_FLOOR;
+        steerDirection = STOP;
+        setDirection(FWD);
+
+        if(position < 0){
+            leftSteer = 100 - (int) amount;
+            rightSteer = 100;
+        }
+        else{
+            leftSteer = 100;
+            rightSteer = 100 - (int) amount;
+        }
+} //end steerTo
+
+/*******************************************************************************
+ * Function:        initMotors
+ *
+ * PreCondition:    PORTB is set as outputs
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    OC1 and OC2 start driving the enable pins, rampMotors
+ *                  runs from the 1ms tick
+ *
+ * Overview:  Sets up OC1 and OC2 as edge-aligned PWM outputs clocked from
+ *            Fcyc. Each module times its own period from OCxRS, so no
+ *            timer is used. Both wheels start stopped with a full speed
+ *            target.
+ *
+ * Note:      PWM_PERIOD is 200 counts at 4MHz (0.5% steps) and 800 counts
+ *            with USE_FRCPLL.
+ ******************************************************************************/
+
+void initMotors (void)
+{
+        OC1CON1 = 0;		//Turn off OC1 while it is configured
+        OC1CON2 = 0;
+        OC1CON1bits.OCTSEL = 7;	//Fcyc as the clock source
+        OC1CON2bits.SYNCSEL = 0x1F;	//period set by OC1RS
+        OC1RS = PWM_PERIOD - 1;
+
+        OC2CON1 = 0;		//Turn off OC2 while it is configured
+        OC2CON2 = 0;
+        OC2CON1bits.OCTSEL = 7;
+        OC2CON2bits.SYNCSEL = 0x1F;
+        OC2RS = PWM_PERIOD - 1;
+
+        setDuty(100, 100);
+        drive(STOP);
+        writeDuty();
+
+        OC1CON1bits.OCM = 6;	//Edge-aligned PWM
+        OC2CON1bits.OCM = 6;
+
+        tickHook = rampMotors;	//ramp the speeds every millisecond
+} //end initMotors
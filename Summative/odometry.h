@@ -0,0 +1,150 @@
+//odometry.h
+/*********************************************************************
+ This contains all functions that count wheel encoder pulses and keep
+ track of how far the robot has gone and how far it has turned. Each
+ wheel has a single channel slotted disc encoder. Nothing here touches
+ the pins: encoders.h feeds the edges in from the change notification
+ interrupt, and test/testOdometry.c feeds in simulated edges on a PC.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define TICKS_PER_REV 40 //encoder edges per wheel turn (20 slots, both edges)
+#define WHEEL_DIAMETER 66 //diameter of the wheels (mm)
+#define WHEEL_BASE 135 //distance between the middle of the two wheels (mm)
+#define UM_PER_TICK (WHEEL_DIAMETER * 3142l / TICKS_PER_REV) //distance a wheel moves in one edge (um)
+
+//the counts change in the CN interrupt, which is held off while both are read
+#ifdef __XC16__
+#define HOLD_ENCODERS() (IEC1bits.CNIE = 0)
+#define RELEASE_ENCODERS() (IEC1bits.CNIE = 1)
+#else
+#define HOLD_ENCODERS() //no interrupt on a PC
+#define RELEASE_ENCODERS()
+#endif
+
+//	Global Variables
+/********************************************************************/
+
+volatile long leftTicks = 0; //left wheel edges, less the ones going backward
+volatile long rightTicks = 0; //right wheel edges, less the ones going backward
+int leftSign = 1; //direction the left wheel was last driven, for coasting
+int rightSign = 1; //direction the right wheel was last driven, for coasting
+int encoderSeen = 0; //set once any encoder edge has been counted
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        countEncoder
+ *
+ * PreCondition:    -
+ *
+ * Input:           wheel that moved (0 for left, 1 for right)
+ *
+ * Output:          none
+ *
+ * Side Effects:    leftTicks or rightTicks changes by one, encoderSeen is set
+ *
+ * Overview:  Counts one encoder edge. A single channel encoder cannot tell
+ *            which way the wheel turns, so the direction on the wheel's L293
+ *            inputs is used (leftDriven or rightDriven in motor.h), not the
+ *            one asked for; a wheel that is off, held for a dead time or
+ *            still coasting keeps the direction it was last driven.
+ *
+ * Note:      Called from encoderEdge on the robot, and by the host test to
+ *            stand in for the encoders.
+ ******************************************************************************/
+
+void countEncoder (int wheel)
+{
+        if(leftDriven) leftSign = leftDriven;
+        if(rightDriven) rightSign = rightDriven;
+
+        encoderSeen = 1;
+        if(wheel == 0) leftTicks += leftSign;
+        else rightTicks += rightSign;
+} //end countEncoder
+
+/*******************************************************************************
+ * Function:        resetOdometry
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Clears both encoder counts, so distance and heading are
+ *            measured from here.
+ *
+ * Note:
+ ******************************************************************************/
+
+void resetOdometry (void)
+{
+        HOLD_ENCODERS();
+        leftTicks = 0;
+        rightTicks = 0;
+        RELEASE_ENCODERS();
+} //end resetOdometry
+
+/*******************************************************************************
+ * Function:        odometryDistance
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          distance the middle of the robot has moved in millimetres,
+ *                  negative when it went backward
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Mean of the distance of both wheels since resetOdometry.
+ *
+ * Note:      A pivot turn moves the wheels opposite ways and adds nothing.
+ ******************************************************************************/
+
+long odometryDistance (void)
+{
+        long ticks;
+
+        HOLD_ENCODERS();	//read both counts together
+        ticks = leftTicks + rightTicks;
+        RELEASE_ENCODERS();
+
+        return ticks * UM_PER_TICK / 2000l;
+} //end odometryDistance
+
+/*******************************************************************************
+ * Function:        odometryHeading
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          angle the robot has turned in tenths of a degree,
+ *                  positive counterclockwise
+ *
+ * Side Effects:    none
+ *
+ * Overview:  The difference in distance of the two wheels over the wheel
+ *            base is the angle turned in radians since resetOdometry.
+ *
+ * Note:
+ ******************************************************************************/
+
+long odometryHeading (void)
+{
+        long ticks;
+
+        HOLD_ENCODERS();	//read both counts together
+        ticks = rightTicks - leftTicks;
+        RELEASE_ENCODERS();
+
+        return ticks * UM_PER_TICK / WHEEL_BASE * 573l / 1000l;
+} //end odometryHeading
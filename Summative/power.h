@@ -0,0 +1,80 @@
+//power.h
+/*********************************************************************
+ This contains all functions that deal with putting the CPU into
+ Idle mode while it has nothing to do
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define T4_US_PER_COUNT (64000000ul / FCY) //Timer4 count time with 1:64 prescale
+#define IDLE_MIN 50ul //shortest time worth idling for (us)
+#define IDLE_MAX (65535ul * T4_US_PER_COUNT) //longest time Timer4 can count (us)
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        idleFor
+ *
+ * PreCondition:    -
+ *
+ * Input:           number of microseconds
+ *
+ * Output:          none
+ *
+ * Side Effects:    Timer4 is used as the wake-up timer
+ *
+ * Overview:  Puts the CPU in Idle mode for up to the given time. The timers
+ *            and the other peripherals keep running in Idle; only the CPU
+ *            stops. Timer4 is loaded as a one-shot wake-up so the CPU
+ *            is back before the time is up. Any other interrupt, such as
+ *            the 1ms Timer1 tick, wakes the CPU sooner, so callers must
+ *            check the time again and call idleFor in a loop.
+ *
+ * Note:      Timer4 uses Fcyc with a 1:64 prescale (16us per count, 4us
+ *            with USE_FRCPLL), so the longest idle is 1048ms (262ms). Times
+ *            under IDLE_MIN return right away because waking up takes about
+ *            that long.
+ ******************************************************************************/
+
+void idleFor (unsigned long micro)
+{
+        if(micro < IDLE_MIN) return;
+        if(micro > IDLE_MAX) micro = IDLE_MAX;
+
+        T4CON = 0;		//Stop Timer4, Fcyc source
+        T4CONbits.TCKPS = 2;	//1:64 prescale
+        TMR4 = 0;
+        PR4 = (unsigned int) ((micro - IDLE_MIN / 2) / T4_US_PER_COUNT);
+
+        IFS1bits.T4IF = 0;	// Clear out the T4 flag
+        IEC1bits.T4IE = 1;	// Enable the Timer4 interrupt
+        T4CONbits.TON = 1;	// Turn on Timer4
+
+        Idle();			//wait for any interrupt
+} //end idleFor
+
+/*******************************************************************************
+ * Function:        _T4Interrupt
+ *
+ * PreCondition:    idleFor has started Timer4
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    Timer4 is stopped
+ *
+ * Overview:  Timer4 interrupt service routine. Wakes the CPU from Idle and
+ *            stops the one-shot wake-up timer.
+ *
+ * Note:
+ ******************************************************************************/
+
+void __attribute__((__interrupt__, no_auto_psv)) _T4Interrupt (void)
+{
+        T4CONbits.TON = 0;
+        IEC1bits.T4IE = 0;
+        IFS1bits.T4IF = 0;
+} //end _T4Interrupt
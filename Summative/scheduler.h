@@ -0,0 +1,180 @@
+//scheduler.h
+/*********************************************************************
+ This contains all functions that deal with running tasks at fixed
+ rates from the Timer1 system tick
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define MAX_TASKS 4 //most tasks that can be added
+
+//	Global Variables
+/********************************************************************/
+
+void (*taskFunction[MAX_TASKS])(void); //function run by each task
+unsigned long taskPeriod[MAX_TASKS]; //time between runs (us)
+unsigned long taskNext[MAX_TASKS]; //micros() when the task is next due
+unsigned long taskWorst[MAX_TASKS]; //longest time a run has taken (us)
+unsigned int taskOverruns[MAX_TASKS]; //runs that finished after the next was due
+unsigned long taskJitterMin[MAX_TASKS]; //earliest start after the due time (us)
+unsigned long taskJitterMax[MAX_TASKS]; //latest start after the due time (us)
+unsigned long taskJitterSum[MAX_TASKS]; //total of all start times, for the mean (us)
+unsigned long taskRuns[MAX_TASKS]; //number of runs measured
+int taskCount = 0; //number of tasks added
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        addTask
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           function to run and the time between runs in microseconds
+ *
+ * Output:          task number, or -1 if the table is full
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Adds a task to the table. The task is first run on the next
+ *            call to runTasks and then once every period after that.
+ *
+ * Note:      Tasks are run in the order they were added, so add the fastest
+ *            task first.
+ ******************************************************************************/
+
+int addTask (void (*function)(void), unsigned long period)
+{
+        if(taskCount >= MAX_TASKS) return -1;
+
+        taskFunction[taskCount] = function;
+        taskPeriod[taskCount] = period;
+        taskNext[taskCount] = micros();
+        taskWorst[taskCount] = 0;
+        taskOverruns[taskCount] = 0;
+        taskJitterMin[taskCount] = 0xFFFFFFFFul;
+        taskJitterMax[taskCount] = 0;
+        taskJitterSum[taskCount] = 0;
+        taskRuns[taskCount] = 0;
+
+        return taskCount++;
+} //end addTask
+
+/*******************************************************************************
+ * Function:        runTasks
+ *
+ * PreCondition:    tasks have been added with addTask
+ *
+ * Input:           none
+ *
+ * Output:          none
+ *
+ * Side Effects:    each task that is due is run once, then the CPU idles
+ *
+ * Overview:  Runs every task whose time has come and times it. Tasks are
+ *            due at fixed times a whole period apart, so a task's rate does
+ *            not depend on how long the loop takes. How late each run
+ *            starts is kept in the jitter arrays. A task must return well
+ *            within its period; it must never wait on a sensor or call
+ *            delay(). A run that is still going when the next one is due
+ *            counts as an overrun, and the missed runs are skipped instead
+ *            of being run back to back. When no task is due the CPU idles
+ *            until the soonest one is.
+ *
+ * Note:      Call from the main loop as often as possible.
+ ******************************************************************************/
+
+void runTasks (void)
+{
+        int i;
+        unsigned long begin;
+        unsigned long finish;
+        unsigned long late;
+        long soonest; //time until the soonest task is due
+        long wait;
+
+        for(i = 0; i < taskCount; i++){
+            begin = micros();
+            if((long)(begin - taskNext[i]) < 0) continue; //not due yet
+
+        //measure how late the task starts after its due time
+            late = begin - taskNext[i];
+            if(late < taskJitterMin[i]) taskJitterMin[i] = late;
+            if(late > taskJitterMax[i]) taskJitterMax[i] = late;
+            taskJitterSum[i] += late;
+            taskRuns[i]++;
+
+            taskFunction[i]();
+            finish = micros();
+
+        //keep the longest run time for tuning
+            if(finish - begin > taskWorst[i]) taskWorst[i] = finish - begin;
+
+        //schedule from the due time so the rate does not drift
+            taskNext[i] += taskPeriod[i];
+            if((long)(finish - taskNext[i]) >= 0){
+                taskOverruns[i]++;
+                taskNext[i] = finish + taskPeriod[i]; //skip the missed runs
+            }
+        }
+
+    //idle until the soonest task is due
+        begin = micros();
+        soonest = IDLE_MAX;
+        for(i = 0; i < taskCount; i++){
+            wait = (long)(taskNext[i] - begin);
+            if(wait < soonest) soonest = wait;
+        }
+        if(soonest > 0) idleFor(soonest);
+} //end runTasks
+
+/*******************************************************************************
+ * Function:        overrunCount
+ *
+ * PreCondition:    -
+ *
+ * Input:           none
+ *
+ * Output:          total overruns of all tasks
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Used to report overruns on the indicator LED. The counts for
+ *            each task are in taskOverruns and can be read with the
+ *            debugger.
+ *
+ * Note:
+ ******************************************************************************/
+
+unsigned int overrunCount (void)
+{
+        int i;
+        unsigned int total = 0;
+
+        for(i = 0; i < taskCount; i++) total += taskOverruns[i];
+
+        return total;
+} //end overrunCount
+
+/*******************************************************************************
+ * Function:        taskJitterMean
+ *
+ * PreCondition:    -
+ *
+ * Input:           task number from addTask
+ *
+ * Output:          mean start time after the due time in microseconds
+ *
+ * Side Effects:    none
+ *
+ * Overview:  Mean of the jitter measured by runTasks for one task.
+ *
+ * Note:      Returns 0 before the task's first run.
+ ******************************************************************************/
+
+unsigned long taskJitterMean (int task)
+{
+        if(taskRuns[task] == 0) return 0;
+        return taskJitterSum[task] / taskRuns[task];
+} //end taskJitterMean
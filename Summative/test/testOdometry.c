@@ -0,0 +1,90 @@
+/*
+ * testOdometry.c
+ * Purpose: Checks odometry.h on a PC by feeding it simulated encoder
+ * edges in place of the CN interrupt. Line_Follow_3 uses the same copy of
+ * odometry.h.
+ * Build and run from this folder:
+ *     gcc -std=gnu89 -Wall -o testOdometry testOdometry.c && ./testOdometry
+ * Prints each check and exits with 1 if any of them fails.
+*/
+
+//Include Files
+#include <stdio.h>
+
+//directions on the L293 inputs, from motor.h on the robot
+volatile int leftDriven = 0;
+volatile int rightDriven = 0;
+
+#include "../odometry.h"
+
+//Local Function Prototypes
+void feedEdges (int left, int right, int leftEdges, int rightEdges);
+void check (const char *name, long value, long expected, long tolerance);
+
+int failures = 0; //number of checks that failed
+
+int main (void)
+{
+    //one full turn of both wheels forward is pi times the wheel diameter
+    resetOdometry();
+    feedEdges(1, 1, TICKS_PER_REV, TICKS_PER_REV);
+    check("forward turn distance (mm)", odometryDistance(), 207, 1);
+    check("forward turn heading (0.1 deg)", odometryHeading(), 0, 0);
+
+    //the same backward
+    resetOdometry();
+    feedEdges(-1, -1, TICKS_PER_REV, TICKS_PER_REV);
+    check("backward turn distance (mm)", odometryDistance(), -207, 1);
+
+    //pivot counterclockwise, each wheel goes half a turn (104mm) round the 135mm base, 88 degrees
+    resetOdometry();
+    feedEdges(-1, 1, 20, 20);
+    check("CCW pivot distance (mm)", odometryDistance(), 0, 0);
+    check("CCW pivot heading (0.1 deg)", odometryHeading(), 880, 10);
+
+    //and clockwise
+    resetOdometry();
+    feedEdges(1, -1, 20, 20);
+    check("CW pivot heading (0.1 deg)", odometryHeading(), -880, 10);
+
+    //only the right wheel turning swings left about the left wheel
+    resetOdometry();
+    feedEdges(0, 1, 0, 40);
+    check("LEFT turn distance (mm)", odometryDistance(), 103, 1);
+    check("LEFT turn heading (0.1 deg)", odometryHeading(), 880, 10);
+
+    //a wheel that is off or held for a dead time keeps counting the way it was last driven
+    resetOdometry();
+    feedEdges(-1, -1, 10, 10);
+    feedEdges(0, 0, 10, 10);
+    check("coasting backward distance (mm)", odometryDistance(), -103, 1);
+
+    if(failures) printf("%d check(s) failed\n", failures);
+    else printf("all checks passed\n");
+    return failures ? 1 : 0;
+} //end main
+
+//sets the wheel directions, then feeds the edges in turn as the CN interrupt would
+void feedEdges (int left, int right, int leftEdges, int rightEdges){
+    leftDriven = left;
+    rightDriven = right;
+    while(leftEdges || rightEdges){
+        if(leftEdges){
+            countEncoder(0);
+            leftEdges--;
+        }
+        if(rightEdges){
+            countEncoder(1);
+            rightEdges--;
+        }
+    }
+}
+
+//prints a check and counts it as failed if it is further than tolerance from expected
+void check (const char *name, long value, long expected, long tolerance){
+    long error = value - expected;
+
+    if(error < 0) error = -error;
+    printf("%s %s: %ld, expected %ld\n", error <= tolerance ? "ok  " : "FAIL", name, value, expected);
+    if(error > tolerance) failures++;
+}
@@ -0,0 +1,193 @@
+//trim.h
+/*********************************************************************
+ This contains all functions that set the speed of each wheel so the
+ robot drives straight. The trim is measured on a straight line and
+ kept in the data EEPROM, so it does not have to be tuned by hand
+ for each chassis.
+********************************************************************/
+
+//	Definitions
+/********************************************************************/
+
+#define TRIM_MAGIC 0x5452 //saved in EE_TRIM_MAGIC once a trim is saved
+#define TRIM_MIN 50 //slowest trim allowed for a wheel (%)
+#define CALIBRATE_TIME 3000ul //time spent following the line to calibrate (ms)
+#define MAX_DRIFT 250 //largest drift corrected by one calibration (per mille)
+
+//	Global Variables
+/********************************************************************/
+
+int leftTrim = 100; //left wheel speed for driving straight (%)
+int rightTrim = 100; //right wheel speed for driving straight (%)
+
+//results of the last calibration, read with the debugger
+unsigned long trimForward = 0; //time spent going forward (ms)
+unsigned long trimLeft = 0; //time spent turning left to get back on the line (ms)
+unsigned long trimRight = 0; //time spent turning right to get back on the line (ms)
+long trimDrift = 0; //measured speed difference, + when the left wheel is faster (per mille)
+
+//functions and constants from the main program
+int digitalRead (int pin);
+void digitalWrite (int pin, int power);
+extern const int left;
+extern const int right;
+
+//	List of Functions
+/********************************************************************/
+
+/*******************************************************************************
+ * Function:        loadTrim
+ *
+ * PreCondition:    initMotors has been called
+ *
+ * Input:           left and right wheel trim in percent to use if none has
+ *                  been saved
+ *
+ * Output:          1 if the trim was read from the EEPROM, 0 if the defaults
+ *                  are used
+ *
+ * Side Effects:    the wheel speeds are set with setDuty
+ *
+ * Overview:  Call at start-up. Uses the trim saved by calibrateTrim if there
+ *            is one, otherwise the hand tuned values of the program.
+ *
+ * Note:      Saved values outside TRIM_MIN to 100 are ignored.
+ ******************************************************************************/
+
+int loadTrim (int leftDefault, int rightDefault)
+{
+        int leftSaved = (int) eeRead(EE_TRIM_LEFT);
+        int rightSaved = (int) eeRead(EE_TRIM_RIGHT);
+        int saved = eeRead(EE_TRIM_MAGIC) == TRIM_MAGIC
+                && leftSaved >= TRIM_MIN && leftSaved <= 100
+                && rightSaved >= TRIM_MIN && rightSaved <= 100;
+
+        if(saved){
+            leftTrim = leftSaved;
+            rightTrim = rightSaved;
+        }
+        else{
+            leftTrim = leftDefault;
+            rightTrim = rightDefault;
+        }
+        setDuty(leftTrim, rightTrim);
+
+        return saved;
+} //end loadTrim
+
+/*******************************************************************************
+ * Function:        waitForButton
+ *
+ * PreCondition:    initTimer has been called
+ *
+ * Input:           PORTB pin of the indicator LED
+ *
+ * Output:          none
+ *
+ * Side Effects:    the LED flashes while waiting and is left off
+ *
+ * Overview:  Waits for the push button on RA2 to be let go, then flashes the
+ *            LED until it is pressed again. Used between the sensor sweep
+ *            and calibrateTrim, so the robot can be put back square on the
+ *            straight line before the trim is measured.
+ *
+ * Note:      Returns as soon as the button is pressed; calibrateTrim waits
+ *            for it to be released.
+ ******************************************************************************/
+
+void waitForButton (int led)
+{
+        while(digitalRead(2));
+        delay(50);		//let the contacts settle
+
+        while(!digitalRead(2)){
+            digitalWrite(led, (millis() / 250) % 2);
+        }
+        digitalWrite(led, 0);
+} //end waitForButton
+
+/*******************************************************************************
+ * Function:        calibrateTrim
+ *
+ * PreCondition:    loadTrim has been called, the robot is on a straight line
+ *                  and the push button on RA2 is held
+ *
+ * Input:           time to follow the line in milliseconds
+ *
+ * Output:          1 if a new trim was saved, 0 if the run was too short
+ *
+ * Side Effects:    the robot drives forward along the line, the trim is
+ *                  saved in the EEPROM
+ *
+ * Overview:  Waits for the button to be released, then follows the line for
+ *            the given time and counts the milliseconds spent going forward
+ *            and turning each way. A robot that keeps drifting one way has
+ *            to turn back the other way; the heading lost going forward at
+ *            the speed difference equals the heading won back turning, so
+ *            (left - right turn time) / forward time is the speed difference
+ *            over the sum of the wheel speeds. The faster wheel is slowed by
+ *            twice that, then both trims are scaled so the faster one is
+ *            100%.
+ *
+ * Note:      The run ends early on a black line. Run it again to refine the
+ *            trim; each run corrects at most MAX_DRIFT.
+ ******************************************************************************/
+
+int calibrateTrim (unsigned long milli)
+{
+        unsigned long begin;
+
+    //let go of the button and move the hand away first
+        while(digitalRead(2));
+        delay(500);
+
+        trimForward = 0;
+        trimLeft = 0;
+        trimRight = 0;
+        begin = millis();
+        while(millis() - begin < milli){
+            if(digitalRead(left) && digitalRead(right)){
+                drive(FWD);
+                trimForward++;
+            }
+            else if(!digitalRead(left) && digitalRead(right)){
+                drive(CCW);
+                trimLeft++;
+            }
+            else if(digitalRead(left) && !digitalRead(right)){
+                drive(CW);
+                trimRight++;
+            }
+            else break; //black line, end of the straight
+            waitPeriod(1000ul);
+        }
+        drive(STOP);
+
+        if(trimForward < milli / 4) return 0; //not enough time on the line
+
+    //slow the faster wheel by the measured difference
+        trimDrift = ((long) trimLeft - (long) trimRight) * 1000l / (long) trimForward;
+        if(trimDrift > MAX_DRIFT) trimDrift = MAX_DRIFT;
+        if(trimDrift < -MAX_DRIFT) trimDrift = -MAX_DRIFT;
+        if(trimDrift > 0) leftTrim = (int) (leftTrim * (1000l - 2 * trimDrift) / 1000l);
+        else rightTrim = (int) (rightTrim * (1000l + 2 * trimDrift) / 1000l);
+
+    //run the faster wheel at full speed
+        if(leftTrim > rightTrim){
+            rightTrim = (int) (rightTrim * 100l / leftTrim);
+            leftTrim = 100;
+        }
+        else{
+            leftTrim = (int) (leftTrim * 100l / rightTrim);
+            rightTrim = 100;
+        }
+        if(leftTrim < TRIM_MIN) leftTrim = TRIM_MIN;
+        if(rightTrim < TRIM_MIN) rightTrim = TRIM_MIN;
+        setDuty(leftTrim, rightTrim);
+
+        eeWrite(EE_TRIM_LEFT, leftTrim);
+        eeWrite(EE_TRIM_RIGHT, rightTrim);
+        eeWrite(EE_TRIM_MAGIC, TRIM_MAGIC);
+
+        return 1;
+} //end calibrateTrim